@@ -1,32 +1,31 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 #include <iostream>
 #include <memory>
 #include <string>
-#include <unordered_set>
+#include <string_view>
 #include <vector>
 #include <cwchar>
 
 #include "utf8.h"
 
 #include "ansi_protocol.h"
+#include "frame_stats.h"
 #include "terminal.h"
+#include "text_output.h"
 
 namespace bbs {
 
-inline bool is_wide(char32_t c)
-{
-    static std::unordered_set<char32_t> const wide{
-        0x1fa78, 0x1f463, 0x1f311, 0x1f3f9, 0x1f4b0, 0x1f480, 0x274c};
-    return wide.contains(c);
-    // return c > 0xffff;
-}
-
 template <typename Protocol = AnsiProtocol>
-class Console
+class Console : public TextOutput<Console<Protocol>>
 {
+    using Text = TextOutput<Console<Protocol>>;
+
 public:
+    using Text::put_bg;
+    using Text::put_fg;
     enum AnsiColors
     {
         WHITE,
@@ -100,29 +99,53 @@ public:
     int32_t width = 0;
     int32_t height = 0;
 
-    int32_t put_x = 0;
-    int32_t put_y = 0;
-    uint32_t put_fg = 0;
-    uint32_t put_bg = 0;
-
     int32_t cur_x = 0;
     int32_t cur_y = 0;
     uint32_t cur_fg = 0;
     uint32_t cur_bg = 0;
 
+    // Set when `grid` is changed through the Console API, cleared by flush().
+    // Code writing directly into `grid` must set it as well.
+    bool dirty = true;
+
+    // Per frame statistics, see frame_stats.h
+    [[no_unique_address]] mutable FrameStats stats;
+
+    // Change the size of the console, keeping the contents of the area
+    // that is visible both before and after. Newly exposed tiles are blank,
+    // which is what the terminal itself shows there.
     void resize(int32_t w, int32_t h)
     {
+        w = std::max(w, 0);
+        h = std::max(h, 0);
+        dirty = true;
+        auto cw = std::min(w, width);
+        auto ch = std::min(h, height);
+        for (auto* g : {&grid, &old_grid}) {
+            std::vector<Tile> resized(w * h, Tile{' ', 0, 0, 0});
+            for (int32_t y = 0; y < ch; y++) {
+                std::copy_n(g->begin() + y * width, cw,
+                            resized.begin() + y * w);
+            }
+            g->swap(resized);
+        }
         width = w;
         height = h;
-        grid.resize(w * h);
-        old_grid.resize(w * h);
-        std::fill(grid.begin(), grid.end(), Tile{' ', 0, 0, 0});
-        std::fill(old_grid.begin(), old_grid.end(), Tile{' ', 0, 0, 0});
+    }
+
+    // Pick up a size change of the terminal. Returns true if the console
+    // was resized.
+    bool check_resize()
+    {
+        if (terminal == nullptr || !terminal->size_changed()) return false;
+        resize(terminal->width(), terminal->height());
+        return true;
     }
 
     void blit(
         int32_t x, int32_t y, int32_t stride, std::vector<Tile> const& from)
     {
+        dirty = true;
         int32_t i = 0;
         auto xx = x;
         for (auto const& c : from) {
@@ -140,37 +163,32 @@ public:
 
     void fill(uint32_t fg, uint32_t bg)
     {
+        dirty = true;
         std::fill(grid.begin(), grid.end(), Tile{' ', fg, bg, 0});
         //utils::fill(grid, Tile{' ', fg, bg, 0});
     }
 
-    void set_xy(int32_t x, int32_t y)
-    {
-        put_x = x;
-        put_y = y;
-    }
-
-    void set_color(uint32_t fg, uint32_t bg)
+    // Called by TextOutput for every glyph that is inside the console
+    void draw_glyph(int32_t x, int32_t y, Char c, bool wide)
     {
-        put_fg = fg;
-        put_bg = bg;
+        dirty = true;
+        auto* t = &grid[x + width * y];
+        t[0] = {c, put_fg, put_bg, 0};
+        // The right half of a wide glyph is not drawn by flush()
+        if (wide) t[1] = {' ', put_fg, put_bg, 0};
     }
 
-    void put(std::string const& text)
+    void put_char(int x, int y, Char c)
     {
-        auto ut = utils::utf8_decode(text);
-        for (auto c : ut) {
-            grid[put_x + width * put_y] = {
-                static_cast<Char>(c), put_fg, put_bg, 0};
-            put_x++;
-        }
+        if (x < 0 || y < 0 || x >= width || y >= height) return;
+        dirty = true;
+        grid[x + width * y].c = c;
     }
 
-    void put_char(int x, int y, Char c) { grid[x + width * y].c = c; }
-
     void put_char(int x, int y, Char c, uint16_t flg)
     {
         if (x < 0 || y < 0 || x >= width || y >= height) return;
+        dirty = true;
         grid[x + width * y].c = c;
         grid[x + width * y].flags = flg;
     }
@@ -178,6 +196,7 @@ public:
     void put_color(int x, int y, uint32_t fg, uint32_t bg)
     {
         if (x < 0 || y < 0 || x >= width || y >= height) return;
+        dirty = true;
         grid[x + width * y].fg = fg;
         grid[x + width * y].bg = bg;
     }
@@ -185,12 +204,99 @@ public:
     void put_color(int x, int y, uint32_t fg, uint32_t bg, uint16_t flg)
     {
         if (x < 0 || y < 0 || x >= width || y >= height) return;
+        dirty = true;
         grid[x + width * y].fg = fg;
         grid[x + width * y].bg = bg;
         grid[x + width * y].flags = flg;
     }
 
-    Tile& at(int x, int y) { return grid[x + width * y]; }
+    // A rectangle of the console that can be drawn into from another
+    // thread. Tiles are written straight into `grid` without locking, so
+    // regions in use at the same time must not overlap, and the console
+    // must not be resized or flushed meanwhile. Once the drawing threads
+    // are done, pass each region to `commit()` on the render thread.
+    class Region : public TextOutput<Region>
+    {
+    public:
+        Region(Console& console, int32_t x, int32_t y, int32_t w, int32_t h)
+        {
+            auto x1 = std::min(x + w, console.width);
+            auto y1 = std::min(y + h, console.height);
+            x = std::max(x, 0);
+            y = std::max(y, 0);
+            width = std::max(x1 - x, 0);
+            height = std::max(y1 - y, 0);
+            stride = console.width;
+            origin = console.grid.data() + x + y * stride;
+            this->set_color(console.put_fg, console.put_bg);
+        }
+
+        bool dirty = false;
+
+        int32_t get_width() const { return width; }
+        int32_t get_height() const { return height; }
+
+        void draw_glyph(int32_t x, int32_t y, Char c, bool wide)
+        {
+            dirty = true;
+            auto* t = &origin[x + stride * y];
+            t[0] = {c, this->put_fg, this->put_bg, 0};
+            if (wide) t[1] = {' ', this->put_fg, this->put_bg, 0};
+        }
+
+        void put_char(int x, int y, Char c)
+        {
+            if (x < 0 || y < 0 || x >= width || y >= height) return;
+            dirty = true;
+            origin[x + stride * y].c = c;
+        }
+
+        void put_color(int x, int y, uint32_t fg, uint32_t bg)
+        {
+            if (x < 0 || y < 0 || x >= width || y >= height) return;
+            dirty = true;
+            origin[x + stride * y].fg = fg;
+            origin[x + stride * y].bg = bg;
+        }
+
+        void fill(uint32_t fg, uint32_t bg)
+        {
+            dirty = true;
+            for (int32_t y = 0; y < height; y++) {
+                std::fill_n(origin + y * stride, width, Tile{' ', fg, bg, 0});
+            }
+        }
+
+        Tile& at(int x, int y)
+        {
+            dirty = true;
+            return origin[x + stride * y];
+        }
+
+    private:
+        Tile* origin;
+        int32_t stride;
+        int32_t width;
+        int32_t height;
+    };
+
+    Region region(int32_t x, int32_t y, int32_t w, int32_t h)
+    {
+        return {*this, x, y, w, h};
+    }
+
+    // Merge the changes made through `r` back into the console
+    void commit(Region& r)
+    {
+        dirty = dirty || r.dirty;
+        r.dirty = false;
+    }
+
+    Tile& at(int x, int y)
+    {
+        dirty = true;
+        return grid[x + width * y];
+    }
 
     Char get_char(int x, int y) { return grid[x + width * y].c; }
 
@@ -199,6 +305,7 @@ public:
 
     void write(std::string_view text) const
     {
+        ANSI_STAT(stats.wrote(text.size()));
         if (terminal != nullptr) {
             terminal->write(text);
         } else {
@@ -207,11 +314,18 @@ public:
         }
     }
 
+    // Block until a key is available or `timeout_ms` passes (-1 = forever)
+    bool wait_key(int timeout_ms) const
+    {
+        return terminal == nullptr || terminal->wait(timeout_ms);
+    }
+
     int32_t read_key() const
     {
         std::string target;
         if (terminal->read(target)) {
             std::string_view const s = target;
+            ANSI_STAT(stats.key_read());
             return Protocol::translate_key(s);
         }
         return 0;
@@ -219,15 +333,30 @@ public:
 
     void flush()
     {
-        using namespace std::string_literals;
+        if (!dirty) return;
+        dirty = false;
+        ANSI_STAT(stats.begin_frame());
         int chars = 0;
         int xy = 0;
         bool skip_next = false;
         cur_x = cur_y = -1;
+        // Top row cells [hide_x0, hide_x1) are under the stats overlay
+        int32_t hide_x0 = 0;
+        int32_t hide_x1 = 0;
+#ifdef ANSI_FRAME_STATS
+        place_overlay();
+        hide_x0 = overlay_x;
+        hide_x1 = overlay_x + overlay_w;
+#endif
         for (int32_t y = 0; y < height; y++) {
             write(Protocol::goto_xy(0, y));
+            xy++;
             skip_next = false;
             for (int32_t x = 0; x < width; x++) {
+                if (y == 0 && x >= hide_x0 && x < hide_x1) {
+                    skip_next = false;
+                    continue;
+                }
                 auto& t0 = old_grid[x + y * width];
                 auto const& t1 = grid[x + y * width];
                 if(skip_next) {
@@ -244,7 +373,7 @@ public:
                     write((t1.flags & 1) != 1
                               ? Protocol::set_color(t1.fg, t1.bg)
                               : Protocol::set_color(t1.bg, t1.fg));
-                    terminal->write(utils::utf8_encode({t1.c}));
+                    write(utils::utf8_encode({t1.c}));
                     bool wide = is_wide(t1.c);
                     cur_x++;
                     if (wide) {
@@ -256,18 +385,55 @@ public:
                 }
             }
         }
-        /* if (chars != 0) { */
-        /*     static int counter = 0; */
-        /*     counter++; */
-        /*     write(Protocol::goto_xy(60, 0)); */
-        /*     write(Protocol::set_color(0xffffff00, 0xff000000)); */
-        /*     write("  ["s + std::to_string(counter) + ":"s +
-         * std::to_string(chars) + "]  "s); */
-        /* } */
-
+#ifdef ANSI_FRAME_STATS
+        stats.current.cells_compared = width * height - overlay_w;
+        stats.current.cells_changed = chars;
+        stats.current.cursor_moves = xy;
+        stats.current.color_changes = chars;
+        if (overlay_w > 0) draw_overlay();
+        stats.end_frame();
+#endif
+
+        if (terminal != nullptr) terminal->flush();
         fflush(stdout);
     }
 
+#ifdef ANSI_FRAME_STATS
+    // Cells covered by the stats overlay on the top row
+    int32_t overlay_x = 0;
+    int32_t overlay_w = 0;
+
+    // The overlay is written straight to the terminal, on top of the grid.
+    // flush() leaves the cells below it alone, so they are not counted as
+    // changed every frame. When the overlay moves or is turned off, the
+    // cells it covered are invalidated and drawn again.
+    void place_overlay()
+    {
+        int32_t x = 0;
+        int32_t w = 0;
+        if (stats.overlay && height > 0) {
+            w = std::min(FrameStats::overlay_width, width);
+            x = width - w;
+        }
+        if (x == overlay_x && w == overlay_w) return;
+        for (int32_t i = overlay_x; i < std::min(width, overlay_x + overlay_w);
+             i++) {
+            old_grid[i].c = 0;
+        }
+        overlay_x = x;
+        overlay_w = w;
+    }
+
+    void draw_overlay()
+    {
+        stats.drawing_overlay = true;
+        write(Protocol::goto_xy(overlay_x, 0));
+        write(Protocol::set_color(0xffffff00, 0xff000000));
+        write(std::string_view(stats.overlay_text()).substr(0, overlay_w));
+        stats.drawing_overlay = false;
+    }
+#endif
+
     void printAll()
     {
         int chars = 0;
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "telnet.h"
+#include "terminal.h"
+
+#ifndef ANSI_ZLIB
+#error "deflate_terminal.h needs zlib, which was not found by CMake"
+#endif
+
+#include <zlib.h>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace bbs {
+
+// Terminal that deflates everything written to it before passing it on to
+// another terminal. Output is collected as is and compressed in one go
+// when `flush()` is called, ie once per `Console::flush()`.
+//
+// For telnet this is MCCP2: offer it with `telnet::will_compress2` and,
+// when the client answers `IAC DO COMPRESS2`, call `start(true)`.
+// Our own client can skip the negotiation and call `start(false)` directly.
+class DeflateTerminal : public Terminal
+{
+public:
+    struct Stats
+    {
+        uint64_t bytes_in = 0;
+        uint64_t bytes_out = 0;
+        // Last flushed frame
+        uint32_t frame_in = 0;
+        uint32_t frame_out = 0;
+        uint32_t frame_us = 0;
+
+        double ratio() const
+        {
+            return bytes_out == 0 ? 0.0
+                                  : static_cast<double>(bytes_in) / bytes_out;
+        }
+    };
+
+    explicit DeflateTerminal(std::unique_ptr<Terminal> inner_, int level = 6)
+        : inner(std::move(inner_))
+    {
+        if (deflateInit(&zs, level) != Z_OK) {
+            throw std::exception();
+        }
+    }
+
+    ~DeflateTerminal() override
+    {
+        if (active) {
+            compress(Z_FINISH);
+        }
+        deflateEnd(&zs);
+    }
+
+    DeflateTerminal(DeflateTerminal const&) = delete;
+    DeflateTerminal& operator=(DeflateTerminal const&) = delete;
+
+    // Start compressing. With `mccp` set the telnet MCCP2 start sequence
+    // is sent first, uncompressed.
+    void start(bool mccp)
+    {
+        if (active) return;
+        if (mccp) {
+            inner->write(telnet::start_compress2);
+        }
+        active = true;
+    }
+
+    bool compressing() const { return active; }
+    Stats const& stats() const { return stats_; }
+
+    size_t write(std::string_view source) override
+    {
+        if (!active) return inner->write(source);
+        pending.append(source);
+        return source.size();
+    }
+
+    void flush() override
+    {
+        if (active && !pending.empty()) {
+            auto t = std::chrono::steady_clock::now();
+            stats_.frame_in = static_cast<uint32_t>(pending.size());
+            stats_.frame_out = compress(Z_SYNC_FLUSH);
+            stats_.frame_us = static_cast<uint32_t>(
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - t)
+                    .count());
+            stats_.bytes_in += stats_.frame_in;
+            stats_.bytes_out += stats_.frame_out;
+        }
+        inner->flush();
+    }
+
+    bool read(std::string& target) override { return inner->read(target); }
+    bool wait(int timeout_ms) override { return inner->wait(timeout_ms); }
+    int width() const override { return inner->width(); }
+    int height() const override { return inner->height(); }
+    std::string term_type() const override { return inner->term_type(); }
+    bool size_changed() override { return inner->size_changed(); }
+
+private:
+    // Deflate all pending output, passing on whatever deflate produces.
+    // Returns the number of compressed bytes.
+    uint32_t compress(int mode)
+    {
+        uint32_t written = 0;
+        zs.next_in = reinterpret_cast<Bytef*>(pending.data());
+        zs.avail_in = static_cast<uInt>(pending.size());
+        do {
+            zs.next_out = out.data();
+            zs.avail_out = static_cast<uInt>(out.size());
+            deflate(&zs, mode);
+            auto n = out.size() - zs.avail_out;
+            if (n > 0) {
+                inner->write(
+                    {reinterpret_cast<char const*>(out.data()), n});
+                written += n;
+            }
+        } while (zs.avail_out == 0);
+        pending.clear();
+        return written;
+    }
+
+    std::unique_ptr<Terminal> inner;
+    z_stream zs{};
+    bool active = false;
+    std::array<Bytef, 16384> out{};
+
+    // Output written since the last flush
+    std::string pending;
+    Stats stats_;
+};
+
+} // namespace bbs
@@ -0,0 +1,185 @@
+#pragma once
+
+// Per frame statistics for `Console::flush()`. Only collected when
+// ANSI_FRAME_STATS is defined; otherwise `FrameStats` is an empty class
+// and the `ANSI_STAT()` statements compile to nothing.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include <string>
+
+#ifdef ANSI_FRAME_STATS
+#    define ANSI_STAT(x) x
+#else
+#    define ANSI_STAT(x)
+#endif
+
+namespace bbs {
+
+struct Frame
+{
+    uint32_t cells_compared = 0;
+    uint32_t cells_changed = 0;
+    uint32_t cursor_moves = 0;
+    uint32_t color_changes = 0;
+    uint32_t bytes = 0;
+    uint32_t writes = 0;
+    uint32_t flush_us = 0;
+    // Time from the first unhandled key being read until it was flushed
+    uint32_t input_latency_us = 0;
+    // Written for the overlay; not included in `bytes` and `writes`
+    uint32_t overlay_bytes = 0;
+};
+
+#ifdef ANSI_FRAME_STATS
+
+class FrameStats
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    static constexpr size_t history = 256;
+
+    struct Summary
+    {
+        uint32_t min = 0;
+        uint32_t median = 0;
+        uint32_t p99 = 0;
+        uint32_t max = 0;
+    };
+
+    // Draw a one line summary of the previous frame in the top right
+    // corner after each flush
+    bool overlay = false;
+    static constexpr int32_t overlay_width = 40;
+    // Set while the overlay is drawn, so its output is counted separately
+    bool drawing_overlay = false;
+    // Write `dump()` to `dump_file` every `dump_interval` frames
+    FILE* dump_file = nullptr;
+    int dump_interval = 0;
+
+    Frame current;
+
+    void begin_frame()
+    {
+        current = {};
+        start = Clock::now();
+    }
+
+    void end_frame()
+    {
+        auto now = Clock::now();
+        current.flush_us = micros(now - start);
+        if (key_time) {
+            current.input_latency_us = micros(now - *key_time);
+            key_time.reset();
+        }
+        frames[count++ % history] = current;
+        if (dump_file != nullptr && dump_interval > 0 &&
+            count % dump_interval == 0) {
+            fputs(dump().c_str(), dump_file);
+        }
+    }
+
+    void key_read()
+    {
+        if (!key_time) key_time = Clock::now();
+    }
+
+    void wrote(size_t bytes)
+    {
+        if (drawing_overlay) {
+            current.overlay_bytes += bytes;
+            return;
+        }
+        current.bytes += bytes;
+        current.writes++;
+    }
+
+    // Number of frames recorded in total
+    uint64_t frame_count() const { return count; }
+
+    // Most recent frame first, `i` < min(history, frame_count())
+    Frame const& frame(size_t i) const
+    {
+        return frames[(count - 1 - i) % history];
+    }
+
+    // Distribution of one field over the recorded frames, eg
+    // `summary(&Frame::bytes)`
+    Summary summary(uint32_t Frame::*field) const
+    {
+        std::array<uint32_t, history> values; // NOLINT
+        auto n = static_cast<size_t>(std::min<uint64_t>(count, history));
+        if (n == 0) return {};
+        for (size_t i = 0; i < n; i++) {
+            values[i] = frames[i].*field;
+        }
+        auto* end = values.data() + n;
+        std::sort(values.data(), end);
+        return {values[0], values[n / 2], values[(n * 99) / 100],
+                values[n - 1]};
+    }
+
+    std::string dump() const
+    {
+        static constexpr std::array<std::pair<char const*, uint32_t Frame::*>,
+                                    9>
+            fields{{{"compared", &Frame::cells_compared},
+                    {"changed", &Frame::cells_changed},
+                    {"moves", &Frame::cursor_moves},
+                    {"colors", &Frame::color_changes},
+                    {"bytes", &Frame::bytes},
+                    {"writes", &Frame::writes},
+                    {"flush_us", &Frame::flush_us},
+                    {"input_us", &Frame::input_latency_us},
+                    {"overlay", &Frame::overlay_bytes}}};
+        std::string result = "frame " + std::to_string(count) + "\n";
+        for (auto const& [name, field] : fields) {
+            auto s = summary(field);
+            std::array<char, 128> line; // NOLINT
+            snprintf(line.data(), line.size(),
+                     "  %-9s min %u med %u p99 %u max %u\n", name, s.min,
+                     s.median, s.p99, s.max);
+            result += line.data();
+        }
+        return result;
+    }
+
+    // Text for the on screen overlay, padded to `overlay_width` so that
+    // it always covers the same cells
+    std::string overlay_text() const
+    {
+        auto const& f = frame(0);
+        std::array<char, 96> text; // NOLINT
+        snprintf(text.data(), text.size(), " %u cells %uB %uw %uus",
+                 f.cells_changed, f.bytes, f.writes, f.flush_us);
+        std::string result = text.data();
+        result.resize(overlay_width, ' ');
+        return result;
+    }
+
+private:
+    static uint32_t micros(Clock::duration d)
+    {
+        return static_cast<uint32_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(d).count());
+    }
+
+    std::array<Frame, history> frames{};
+    uint64_t count = 0;
+    Clock::time_point start;
+    std::optional<Clock::time_point> key_time;
+};
+
+#else
+
+class FrameStats
+{};
+
+#endif
+
+} // namespace bbs
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+// Telnet protocol constants and helpers for remote terminals
+
+namespace bbs::telnet {
+
+enum : uint8_t
+{
+    SE = 240,
+    SB = 250,
+    WILL = 251,
+    WONT = 252,
+    DO = 253,
+    DONT = 254,
+    IAC = 255,
+};
+
+// Options
+enum : uint8_t
+{
+    NAWS = 31,
+    COMPRESS2 = 86,
+};
+
+// Offer MCCP2 compression
+constexpr std::string_view will_compress2{"\xff\xfb\x56", 3};
+// Sent just before the compressed stream starts
+constexpr std::string_view start_compress2{"\xff\xfa\x56\xff\xf0", 5};
+
+// Parse the payload of a NAWS subnegotiation (the bytes between
+// `IAC SB NAWS` and `IAC SE`) into a terminal size. A remote terminal
+// should update its size from this and report it from `size_changed()`.
+inline bool parse_naws(std::string_view data, int& w, int& h)
+{
+    std::array<uint8_t, 4> size{};
+    size_t n = 0;
+    for (size_t i = 0; i < data.size(); i++) {
+        auto c = static_cast<uint8_t>(data[i]);
+        // IAC is doubled inside subnegotiations
+        if (c == IAC &&
+            (++i == data.size() || static_cast<uint8_t>(data[i]) != IAC)) {
+            return false;
+        }
+        if (n == size.size()) return false;
+        size[n++] = c;
+    }
+    if (n != size.size()) return false;
+    w = (size[0] << 8) | size[1];
+    h = (size[2] << 8) | size[3];
+    return true;
+}
+
+} // namespace bbs::telnet
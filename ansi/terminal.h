@@ -1,9 +1,11 @@
 #pragma once
 
+#include <chrono>
 #include <cstdint>
 #include <memory>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <vector>
 
 namespace bbs {
@@ -16,6 +18,24 @@ public:
     virtual size_t write(std::string_view source) = 0;
     virtual bool read(std::string& target) = 0;
 
+    // Called at the end of each frame; terminals that buffer output
+    // should send it now.
+    virtual void flush() {}
+
+    // Block until input is available or `timeout_ms` has passed. A negative
+    // timeout waits forever. Returns true if input may be ready.
+    // Terminals that can wait on their input should override this; the
+    // default just sleeps (at most 10ms when asked to wait forever) and
+    // returns true, so callers poll `read()` without spinning.
+    virtual bool wait(int timeout_ms)
+    {
+        if (timeout_ms != 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(
+                timeout_ms < 0 ? 10 : timeout_ms));
+        }
+        return true;
+    }
+
     //virtual void open() {}
     //virtual void close() {}
 
@@ -23,6 +43,11 @@ public:
     virtual int height() const { return -1; }
     virtual std::string term_type() const { return ""; }
 
+    // Returns true once after the size of the terminal has changed; width()
+    // and height() then return the new size. Remote terminals should flag
+    // this when the client reports a new size (eg telnet NAWS).
+    virtual bool size_changed() { return false; }
+
     virtual ~Terminal() = default;
 };
 
@@ -0,0 +1,155 @@
+#pragma once
+
+#include "utf8.h"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <climits>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+#include <unordered_set>
+
+namespace bbs {
+
+inline bool is_wide(char32_t c)
+{
+    if (c < 0x274c) return false;
+    static std::unordered_set<char32_t> const wide{
+        0x1fa78, 0x1f463, 0x1f311, 0x1f3f9, 0x1f4b0, 0x1f480, 0x274c};
+    return wide.contains(c);
+    // return c > 0xffff;
+}
+
+// The area put() and print() write into. Text outside it (or outside the
+// target) is clipped. With `wrap` set, text continues on the next line of
+// the area instead of being clipped at its right edge.
+struct TextArea
+{
+    int32_t x = 0;
+    int32_t y = 0;
+    int32_t w = INT32_MAX;
+    int32_t h = INT32_MAX;
+    bool wrap = false;
+    int32_t tab_size = 8;
+};
+
+// Text writing on top of a tile grid. `Derived` provides `get_width()`,
+// `get_height()` and `draw_glyph(x, y, c, wide)`, which is only called
+// for glyphs that fit.
+template <typename Derived>
+class TextOutput
+{
+public:
+    int32_t put_x = 0;
+    int32_t put_y = 0;
+    uint32_t put_fg = 0;
+    uint32_t put_bg = 0;
+
+    TextArea text_area;
+
+    void set_xy(int32_t x, int32_t y)
+    {
+        put_x = x;
+        put_y = y;
+    }
+
+    void set_color(uint32_t fg, uint32_t bg)
+    {
+        put_fg = fg;
+        put_bg = bg;
+    }
+
+    void set_text_area(int32_t x, int32_t y, int32_t w, int32_t h,
+                       bool wrap = true)
+    {
+        text_area = {x, y, w, h, wrap, text_area.tab_size};
+        set_xy(x, y);
+    }
+
+    void reset_text_area() { text_area = {}; }
+
+    // Write UTF-8 text at the put position, advancing it. '\n' moves to
+    // the start of the next line in the text area, '\t' to the next tab
+    // stop; other control characters are ignored.
+    void put(std::string_view text)
+    {
+        uint32_t codepoint = 0;
+        uint32_t state = 0;
+        for (auto s : text) {
+            if (utils::decode(&state, &codepoint, s) == 0) {
+                put_glyph(static_cast<char32_t>(codepoint));
+            }
+        }
+    }
+
+    // Write each argument in turn; strings as text, numbers formatted
+    // in place without allocating.
+    template <typename... ARGS>
+    void print(ARGS const&... args)
+    {
+        (put_arg(args), ...);
+    }
+
+    void put_glyph(char32_t c)
+    {
+        auto& self = static_cast<Derived&>(*this);
+        auto left = std::max(text_area.x, 0);
+        auto top = std::max(text_area.y, 0);
+        auto right = static_cast<int32_t>(std::min<int64_t>(
+            static_cast<int64_t>(text_area.x) + text_area.w,
+            self.get_width()));
+        auto bottom = static_cast<int32_t>(std::min<int64_t>(
+            static_cast<int64_t>(text_area.y) + text_area.h,
+            self.get_height()));
+
+        if (c == '\n') {
+            put_x = text_area.x;
+            put_y++;
+            return;
+        }
+        if (c == '\t') {
+            auto tab = std::max(text_area.tab_size, 1);
+            auto next = text_area.x + ((put_x - text_area.x) / tab + 1) * tab;
+            if (text_area.wrap && next > right) {
+                put_glyph('\n');
+                return;
+            }
+            while (put_x < next) {
+                put_glyph(' ');
+            }
+            return;
+        }
+        if (c < 0x20) return;
+
+        bool const wide = is_wide(c);
+        int32_t const advance = wide ? 2 : 1;
+        if (text_area.wrap && put_x + advance > right && put_x > left) {
+            put_x = text_area.x;
+            put_y++;
+        }
+        if (put_y >= top && put_y < bottom && put_x >= left &&
+            put_x + advance <= right) {
+            self.draw_glyph(put_x, put_y, c, wide);
+        }
+        put_x += advance;
+    }
+
+    void put_arg(std::string_view text) { put(text); }
+    void put_arg(char const* text) { put(text); }
+    void put_arg(char c) { put_glyph(static_cast<uint8_t>(c)); }
+    void put_arg(char32_t c) { put_glyph(c); }
+    void put_arg(bool b) { put(b ? "true" : "false"); }
+
+    template <typename T>
+        requires std::is_arithmetic_v<T>
+    void put_arg(T v)
+    {
+        std::array<char, 64> buf; // NOLINT
+        auto [end, ec] = std::to_chars(buf.data(), buf.data() + buf.size(), v);
+        put(std::string_view(buf.data(), end - buf.data()));
+    }
+};
+
+} // namespace bbs
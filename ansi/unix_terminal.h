@@ -2,10 +2,15 @@
 
 #include "terminal.h"
 
+#include <array>
 #include <cassert>
+#include <cerrno>
 #include <cstring>
 #include <tuple>
 
+#include <fcntl.h>
+#include <poll.h>
+#include <csignal>
 #include <sys/ioctl.h>
 #include <termios.h>
 #include <unistd.h>
@@ -34,6 +39,22 @@ struct LocalTerminal : public Terminal
         if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) < 0)
             LOGD("IOCTL FAIL");
 
+        // SIGWINCH is turned into a readable byte on a pipe, so it can be
+        // waited on together with stdin.
+        if (pipe(winch_pipe()) == 0) {
+            for (auto fd : {winch_pipe()[0], winch_pipe()[1]}) {
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                fcntl(fd, F_SETFD, FD_CLOEXEC);
+            }
+            struct sigaction sa{}; // NOLINT
+            sa.sa_handler = &on_winch;
+            sa.sa_flags = SA_RESTART;
+            sigemptyset(&sa.sa_mask);
+            sigaction(SIGWINCH, &sa, &orig_winch);
+        } else {
+            LOGD("PIPE FAIL");
+        }
+
         setvbuf(stdout, nullptr, _IONBF, 0);
     }
 
@@ -54,6 +75,26 @@ struct LocalTerminal : public Terminal
     {
         LOGD("Restoring terminal");
         tcsetattr(fileno(stdin), TCSANOW, &orig_term_attr);
+        if (winch_pipe()[0] >= 0) {
+            sigaction(SIGWINCH, &orig_winch, nullptr);
+            close(winch_pipe()[0]);
+            close(winch_pipe()[1]);
+            winch_pipe()[0] = winch_pipe()[1] = -1;
+        }
+    }
+
+    bool size_changed() override
+    {
+        std::array<char, 16> buf; // NOLINT
+        bool changed = false;
+        while (winch_pipe()[0] >= 0 &&
+               ::read(winch_pipe()[0], buf.data(), buf.size()) > 0) {
+            changed = true;
+        }
+        if (changed && ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) < 0) {
+            LOGD("IOCTL FAIL");
+        }
+        return changed;
     }
 
     size_t write(std::string_view source) override
@@ -64,6 +105,14 @@ struct LocalTerminal : public Terminal
         return rc;
     }
 
+    // Also returns when the terminal is resized; check `size_changed()`
+    bool wait(int timeout_ms) override
+    {
+        std::array<pollfd, 2> fds{{{STDIN_FILENO, POLLIN, 0},
+                                   {winch_pipe()[0], POLLIN, 0}}};
+        return poll(fds.data(), fds.size(), timeout_ms) > 0;
+    }
+
     bool read(std::string& target) override
     {
         auto size = target.capacity();
@@ -81,6 +130,22 @@ struct LocalTerminal : public Terminal
     }
 
 private:
+    static int* winch_pipe()
+    {
+        static std::array<int, 2> fds{-1, -1};
+        return fds.data();
+    }
+
+    // Restores errno, which write() may change under the interrupted code
+    static void on_winch(int)
+    {
+        auto const saved_errno = errno;
+        char const c = 0;
+        [[maybe_unused]] auto rc = ::write(winch_pipe()[1], &c, 1);
+        errno = saved_errno;
+    }
+
+    struct sigaction orig_winch{}; // NOLINT
     struct termios orig_term_attr;
     struct winsize ws;
 };
@@ -0,0 +1,308 @@
+// Headless balancing simulator. Plays every pair of robot configurations
+// against each other many times, in parallel, and writes win rates and
+// damage statistics to a result file.
+//
+//   robo_sim [-n matches] [-t threads] [-s seed] [-o result.txt] config.txt
+//
+// The config has one robot per line:
+//
+//   tank hp=14 range=4 reaction=stop_and_fire ai=aggressive
+//        deck=move*6,turn*2,wait*2 upgrades=hp,damage
+//
+// Every match is seeded from (seed, pair, match number), so results do not
+// depend on the number of threads.
+
+#include "battle.h"
+#include "parallel.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace robo;
+
+namespace {
+
+// Cache line aligned, so that the totals of different threads never
+// share a line
+struct alignas(64) Totals
+{
+    uint64_t matches = 0;
+    uint64_t wins = 0;
+    uint64_t losses = 0;
+    uint64_t damage = 0;
+    uint64_t shots = 0;
+    uint64_t hits = 0;
+    uint64_t turns = 0;
+
+    void add(MatchResult const& m, int side)
+    {
+        matches++;
+        wins += m.winner == side ? 1 : 0;
+        losses += m.winner == 1 - side ? 1 : 0;
+        damage += m.robots[side].damage_dealt;
+        shots += m.robots[side].shots;
+        hits += m.robots[side].hits;
+        turns += m.turns;
+    }
+
+    void add(Totals const& t)
+    {
+        matches += t.matches;
+        wins += t.wins;
+        losses += t.losses;
+        damage += t.damage;
+        shots += t.shots;
+        hits += t.hits;
+        turns += t.turns;
+    }
+};
+
+template <typename T, size_t N>
+bool lookup(std::string const& name,
+            std::array<std::pair<char const*, T>, N> const& names, T& out)
+{
+    for (auto const& [n, v] : names) {
+        if (name == n) {
+            out = v;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Parse "move*6,turn" style lists
+template <typename T, size_t N>
+bool parse_list(std::string const& text,
+                std::array<std::pair<char const*, T>, N> const& names,
+                std::vector<T>& out)
+{
+    std::istringstream ss(text);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        int count = 1;
+        auto star = item.find('*');
+        if (star != std::string::npos) {
+            count = std::atoi(item.c_str() + star + 1);
+            item.resize(star);
+        }
+        T value;
+        if (!lookup(item, names, value) || count < 0) return false;
+        out.insert(out.end(), count, value);
+    }
+    return true;
+}
+
+std::optional<RobotConfig> parse_robot(std::string const& line)
+{
+    static constexpr std::array<std::pair<char const*, Action>, 3> actions{
+        {{"move", Action::Move},
+         {"turn", Action::TurnHead},
+         {"wait", Action::Wait}}};
+    static constexpr std::array<std::pair<char const*, Upgrade>, 4> upgrades{
+        {{"damage", Upgrade::Damage},
+         {"range", Upgrade::Range},
+         {"hp", Upgrade::Hp},
+         {"sight", Upgrade::Sight}}};
+    static constexpr std::array<std::pair<char const*, Reaction>, 3>
+        reactions{{{"avoid", Reaction::Avoid},
+                   {"moving_attack", Reaction::MovingAttack},
+                   {"stop_and_fire", Reaction::StopAndFire}}};
+    static constexpr std::array<std::pair<char const*, Ai>, 3> ais{
+        {{"aggressive", Ai::Aggressive},
+         {"kiter", Ai::Kiter},
+         {"random", Ai::Random}}};
+
+    std::istringstream ss(line);
+    RobotConfig robot;
+    ss >> robot.name;
+    std::string kv;
+    while (ss >> kv) {
+        auto eq = kv.find('=');
+        if (eq == std::string::npos) return std::nullopt;
+        auto key = kv.substr(0, eq);
+        auto value = kv.substr(eq + 1);
+        bool ok = true;
+        if (key == "hp") {
+            robot.hp = std::atoi(value.c_str());
+        } else if (key == "damage") {
+            robot.damage = std::atoi(value.c_str());
+        } else if (key == "range") {
+            robot.range = std::atoi(value.c_str());
+        } else if (key == "sight") {
+            robot.sight = std::atoi(value.c_str());
+        } else if (key == "reaction") {
+            ok = lookup(value, reactions, robot.reaction);
+        } else if (key == "ai") {
+            ok = lookup(value, ais, robot.ai);
+        } else if (key == "deck") {
+            ok = parse_list(value, actions, robot.deck);
+        } else if (key == "upgrades") {
+            ok = parse_list(value, upgrades, robot.upgrades);
+        } else {
+            ok = false;
+        }
+        if (!ok) return std::nullopt;
+    }
+    if (robot.deck.empty()) {
+        robot.deck.assign(8, Action::Move);
+        robot.deck.insert(robot.deck.end(), 2, Action::TurnHead);
+    }
+    return robot;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    uint64_t matches = 100000;
+    unsigned threads = std::max(std::thread::hardware_concurrency(), 1U);
+    uint64_t seed = 1;
+    std::string out_name = "sim_result.txt";
+    std::string config_name;
+
+    for (int i = 1; i < argc; i++) {
+        std::string const arg = argv[i];
+        bool const has_value = i + 1 < argc;
+        if (arg == "-n" && has_value) {
+            matches = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "-t" && has_value) {
+            threads = std::max(std::atoi(argv[++i]), 1);
+        } else if (arg == "-s" && has_value) {
+            seed = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "-o" && has_value) {
+            out_name = argv[++i];
+        } else {
+            config_name = arg;
+        }
+    }
+
+    std::ifstream config_file(config_name);
+    if (!config_file) {
+        fprintf(stderr, "usage: %s [-n matches] [-t threads] [-s seed] "
+                        "[-o result] config\n",
+                argv[0]);
+        return 1;
+    }
+    std::vector<RobotConfig> robots;
+    std::string line;
+    for (int n = 1; std::getline(config_file, line); n++) {
+        if (line.empty() || line[0] == '#') continue;
+        auto robot = parse_robot(line);
+        if (!robot) {
+            fprintf(stderr, "%s:%d: Bad robot config\n", config_name.c_str(),
+                    n);
+            return 1;
+        }
+        robots.push_back(std::move(*robot));
+    }
+    if (robots.size() < 2) {
+        fprintf(stderr, "Need at least two robots\n");
+        return 1;
+    }
+
+    std::vector<std::pair<size_t, size_t>> pairs;
+    for (size_t a = 0; a < robots.size(); a++) {
+        for (size_t b = a + 1; b < robots.size(); b++) {
+            pairs.emplace_back(a, b);
+        }
+    }
+
+    // Work is handed out in batches of matches; each thread keeps its own
+    // battle state and totals, merged at the end.
+    constexpr uint64_t batch = 1024;
+    uint64_t const total = matches * pairs.size();
+    struct alignas(64) Worker
+    {
+        Battle battle;
+        Rng rng;
+        std::vector<Totals> totals;
+    };
+    std::vector<Worker> workers(threads);
+    for (auto& w : workers) {
+        w.totals.resize(pairs.size() * 2);
+    }
+
+    auto work = [&](size_t i, unsigned t) {
+        auto& [battle, rng, totals] = workers[t];
+        auto start = i * batch;
+        auto end = std::min(start + batch, total);
+        for (auto job = start; job < end; job++) {
+            auto p = job / matches;
+            auto m = job % matches;
+            rng.reseed(hash_seed(seed, static_cast<int64_t>(p),
+                                 static_cast<int64_t>(m)));
+            // Swap sides every other match
+            auto swap = (m & 1) != 0;
+            auto const& [a, b] = pairs[p];
+            auto const& first = robots[swap ? b : a];
+            auto const& second = robots[swap ? a : b];
+            auto result = battle.run(first, second, rng);
+            totals[p * 2].add(result, swap ? 1 : 0);
+            totals[p * 2 + 1].add(result, swap ? 0 : 1);
+        }
+    };
+
+    auto t0 = std::chrono::steady_clock::now();
+    parallel_for((total + batch - 1) / batch, threads, work);
+    double const secs =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - t0)
+            .count();
+
+    std::vector<Totals> pair_totals(pairs.size() * 2);
+    std::vector<Totals> robot_totals(robots.size());
+    for (auto const& w : workers) {
+        auto const& r = w.totals;
+        for (size_t i = 0; i < r.size(); i++) {
+            pair_totals[i].add(r[i]);
+            auto const& [a, b] = pairs[i / 2];
+            robot_totals[i % 2 == 0 ? a : b].add(r[i]);
+        }
+    }
+
+    FILE* out = fopen(out_name.c_str(), "w");
+    if (out == nullptr) {
+        fprintf(stderr, "Could not write %s\n", out_name.c_str());
+        return 1;
+    }
+    fprintf(out, "# matches %llu seed %llu threads %u time %.3fs %.0f/s\n",
+            static_cast<unsigned long long>(total),
+            static_cast<unsigned long long>(seed), threads, secs,
+            static_cast<double>(total) / secs);
+    auto print = [&](char const* name, char const* vs, Totals const& t) {
+        auto n = static_cast<double>(std::max<uint64_t>(t.matches, 1));
+        fprintf(out, "%-12s %-12s %8.4f %8.4f %8.2f %8.2f %8.4f %8.2f\n", name,
+                vs, static_cast<double>(t.wins) / n,
+                static_cast<double>(t.losses) / n,
+                static_cast<double>(t.damage) / n,
+                static_cast<double>(t.shots) / n,
+                t.shots == 0 ? 0.0
+                             : static_cast<double>(t.hits) /
+                                   static_cast<double>(t.shots),
+                static_cast<double>(t.turns) / n);
+    };
+    fprintf(out, "%-12s %-12s %8s %8s %8s %8s %8s %8s\n", "# robot", "vs",
+            "win", "loss", "damage", "shots", "accuracy", "turns");
+    for (size_t i = 0; i < pair_totals.size(); i++) {
+        auto const& [a, b] = pairs[i / 2];
+        auto self = i % 2 == 0 ? a : b;
+        auto other = i % 2 == 0 ? b : a;
+        print(robots[self].name.c_str(), robots[other].name.c_str(),
+              pair_totals[i]);
+    }
+    for (size_t i = 0; i < robots.size(); i++) {
+        print(robots[i].name.c_str(), "*", robot_totals[i]);
+    }
+    fclose(out);
+
+    printf("%llu matches in %.3fs (%.0f matches/s)\n",
+           static_cast<unsigned long long>(total), secs,
+           static_cast<double>(total) / secs);
+    return 0;
+}
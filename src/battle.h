@@ -0,0 +1,322 @@
+#pragma once
+
+#include "random.h"
+#include "turn_protocol.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// Headless battle rules, used by the balancing simulator. A match is two
+// robots in an open arena. Every turn each robot draws a hand from its
+// deck, its AI assigns the cards to the action slots, and the slots are
+// played out one step at a time with reactions when the other robot is
+// spotted.
+
+namespace robo {
+
+enum class Upgrade : uint8_t
+{
+    Damage,
+    Range,
+    Hp,
+    Sight,
+};
+
+enum class Ai : uint8_t
+{
+    Aggressive, // Close in on the enemy
+    Kiter,      // Stay at weapon range
+    Random,
+};
+
+struct RobotConfig
+{
+    std::string name;
+    int32_t hp = 10;
+    int32_t damage = 1;
+    int32_t range = 5;
+    int32_t sight = 8;
+    Reaction reaction = Reaction::StopAndFire;
+    Ai ai = Ai::Aggressive;
+    // Cards in the deck; only the action matters, direction is chosen by
+    // the AI when the card is played
+    std::vector<Action> deck;
+    std::vector<Upgrade> upgrades;
+
+    struct Stats
+    {
+        int32_t hp;
+        int32_t damage;
+        int32_t range;
+        int32_t sight;
+    };
+
+    // Stats with upgrades applied
+    Stats stats() const
+    {
+        Stats r{hp, damage, range, sight};
+        for (auto u : upgrades) {
+            switch (u) {
+            case Upgrade::Damage:
+                r.damage++;
+                break;
+            case Upgrade::Range:
+                r.range++;
+                break;
+            case Upgrade::Hp:
+                r.hp += 3;
+                break;
+            case Upgrade::Sight:
+                r.sight += 2;
+                break;
+            }
+        }
+        return r;
+    }
+};
+
+struct RobotResult
+{
+    int32_t damage_dealt = 0;
+    int32_t shots = 0;
+    int32_t hits = 0;
+    bool alive = true;
+};
+
+struct MatchResult
+{
+    // 0 or 1, -1 for a draw
+    int winner = -1;
+    int32_t turns = 0;
+    std::array<RobotResult, 2> robots;
+};
+
+// All state of one match. Meant to be reused between matches on the same
+// thread; nothing is allocated once the decks have been sized.
+class Battle
+{
+public:
+    int32_t arena_size = 24;
+    int32_t max_turns = 100;
+    // Percent chance to hit when standing still; moving attacks roll twice
+    uint32_t hit_chance = 75;
+
+    MatchResult run(RobotConfig const& a, RobotConfig const& b, Rng& rng)
+    {
+        setup(0, a, rng);
+        setup(1, b, rng);
+        // Start in opposite corners, facing each other
+        auto far = arena_size - 1;
+        robots[0].x = rng.range(0, arena_size / 4);
+        robots[0].y = rng.range(0, arena_size / 4);
+        robots[1].x = far - rng.range(0, arena_size / 4);
+        robots[1].y = far - rng.range(0, arena_size / 4);
+        robots[0].head = direction(robots[0], robots[1]);
+        robots[1].head = direction(robots[1], robots[0]);
+
+        MatchResult result;
+        for (result.turns = 1; result.turns <= max_turns; result.turns++) {
+            for (int i = 0; i < 2; i++) {
+                plan(robots[i], robots[1 - i], rng);
+            }
+            for (int step = 0; step < slot_count; step++) {
+                // Alternate who acts first so neither side is favoured
+                auto first = (result.turns + step) & 1;
+                act(robots[first], robots[1 - first], step, rng);
+                act(robots[1 - first], robots[first], step, rng);
+            }
+            if (robots[0].hp <= 0 || robots[1].hp <= 0) break;
+        }
+        result.turns = std::min(result.turns, max_turns);
+        for (int i = 0; i < 2; i++) {
+            auto& r = result.robots[i];
+            r.damage_dealt = robots[i].damage_dealt;
+            r.shots = robots[i].shots;
+            r.hits = robots[i].hits;
+            r.alive = robots[i].hp > 0;
+        }
+        if (result.robots[0].alive != result.robots[1].alive) {
+            result.winner = result.robots[0].alive ? 0 : 1;
+        }
+        return result;
+    }
+
+private:
+    enum class Mode : uint8_t
+    {
+        Normal,
+        Avoiding,
+        Firing,
+    };
+
+    struct Robot
+    {
+        RobotConfig const* config = nullptr;
+        int32_t hp = 0;
+        int32_t damage = 0;
+        int32_t range = 0;
+        int32_t sight = 0;
+        int32_t x = 0;
+        int32_t y = 0;
+        uint8_t head = 0;
+        Mode mode = Mode::Normal;
+
+        std::vector<Action> draw_pile;
+        size_t drawn = 0;
+        Orders orders;
+        // Positions before each move this turn, for backtracking
+        std::array<std::pair<int32_t, int32_t>, slot_count> trail{};
+        int trail_size = 0;
+
+        int32_t damage_dealt = 0;
+        int32_t shots = 0;
+        int32_t hits = 0;
+    };
+
+    void setup(int i, RobotConfig const& config, Rng& rng)
+    {
+        auto& r = robots[i];
+        auto const c = config.stats();
+        r.config = &config;
+        r.hp = c.hp;
+        r.damage = c.damage;
+        r.range = c.range;
+        r.sight = c.sight;
+        r.mode = Mode::Normal;
+        r.draw_pile.assign(config.deck.begin(), config.deck.end());
+        if (r.draw_pile.empty()) r.draw_pile.push_back(Action::Wait);
+        shuffle(r, rng);
+        r.damage_dealt = r.shots = r.hits = 0;
+    }
+
+    static void shuffle(Robot& r, Rng& rng)
+    {
+        auto& p = r.draw_pile;
+        for (auto i = p.size() - 1; i > 0; i--) {
+            std::swap(p[i], p[rng.below(static_cast<uint32_t>(i + 1))]);
+        }
+        r.drawn = 0;
+    }
+
+    static uint8_t direction(Robot const& from, Robot const& to)
+    {
+        auto sx = (to.x > from.x) - (to.x < from.x);
+        auto sy = (to.y > from.y) - (to.y < from.y);
+        for (uint8_t d = 0; d < 8; d++) {
+            if (dir_x[d] == sx && dir_y[d] == sy) return d;
+        }
+        return from.head;
+    }
+
+    static int32_t distance(Robot const& a, Robot const& b)
+    {
+        return std::max(std::abs(a.x - b.x), std::abs(a.y - b.y));
+    }
+
+    // Within sight and no more than 45 degrees off the head direction
+    static bool sees(Robot const& r, Robot const& other)
+    {
+        if (distance(r, other) > r.sight) return false;
+        auto d = direction(r, other);
+        auto diff = (d - r.head + 8) % 8;
+        return diff <= 1 || diff == 7;
+    }
+
+    void plan(Robot& r, Robot const& enemy, Rng& rng)
+    {
+        r.mode = Mode::Normal;
+        r.trail_size = 0;
+        r.orders.reaction = r.config->reaction;
+        auto toward = direction(r, enemy);
+        auto dist = distance(r, enemy);
+        for (auto& slot : r.orders.slots) {
+            if (r.drawn == r.draw_pile.size()) shuffle(r, rng);
+            slot.action = r.draw_pile[r.drawn++];
+            switch (r.config->ai) {
+            case Ai::Aggressive:
+                slot.dir = toward;
+                break;
+            case Ai::Kiter:
+                slot.dir = dist < r.range ? (toward + 4) % 8
+                                          : dist > r.range ? toward
+                                                           : (toward + 2) % 8;
+                break;
+            case Ai::Random:
+                slot.dir = static_cast<uint8_t>(rng.below(8));
+                break;
+            }
+            if (slot.action == Action::TurnHead) slot.dir = toward;
+        }
+    }
+
+    void fire(Robot& r, Robot& target, bool moving, Rng& rng)
+    {
+        if (distance(r, target) > r.range) return;
+        r.shots++;
+        bool hit = rng.chance(hit_chance);
+        if (moving) hit = hit && rng.chance(hit_chance);
+        if (hit) {
+            r.hits++;
+            r.damage_dealt += std::min(r.damage, target.hp);
+            target.hp -= r.damage;
+        }
+    }
+
+    void act(Robot& r, Robot& enemy, int step, Rng& rng)
+    {
+        if (r.hp <= 0 || enemy.hp <= 0) return;
+        auto const& slot = r.orders.slots[step];
+
+        switch (r.mode) {
+        case Mode::Firing:
+            fire(r, enemy, false, rng);
+            return;
+        case Mode::Avoiding:
+            if (r.trail_size > 0) {
+                auto [x, y] = r.trail[--r.trail_size];
+                r.x = x;
+                r.y = y;
+            }
+            if (!sees(r, enemy)) r.mode = Mode::Normal;
+            return;
+        case Mode::Normal:
+            break;
+        }
+
+        bool moved = false;
+        if (slot.action == Action::Move) {
+            auto nx = std::clamp(r.x + dir_x[slot.dir], 0, arena_size - 1);
+            auto ny = std::clamp(r.y + dir_y[slot.dir], 0, arena_size - 1);
+            if ((nx != r.x || ny != r.y) && (nx != enemy.x || ny != enemy.y)) {
+                r.trail[r.trail_size++] = {r.x, r.y};
+                r.x = nx;
+                r.y = ny;
+                moved = true;
+            }
+        } else if (slot.action == Action::TurnHead) {
+            r.head = slot.dir;
+        }
+
+        if (!sees(r, enemy)) return;
+        switch (r.orders.reaction) {
+        case Reaction::Avoid:
+            r.mode = Mode::Avoiding;
+            break;
+        case Reaction::MovingAttack:
+            fire(r, enemy, moved, rng);
+            break;
+        case Reaction::StopAndFire:
+            r.mode = Mode::Firing;
+            fire(r, enemy, false, rng);
+            break;
+        }
+    }
+
+    std::array<Robot, 2> robots;
+};
+
+} // namespace robo
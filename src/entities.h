@@ -0,0 +1,364 @@
+#pragma once
+
+#include "snapshot.h"
+#include "turn_protocol.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <tuple>
+#include <vector>
+
+// Entity storage. Every kind of entity has its own table with one
+// contiguous array per field (structure of arrays), so loops over all
+// robots or all projectiles only touch the fields they use. Entities are
+// referred to by handles that stay valid while rows move around, and
+// become stale when the entity is destroyed.
+//
+// Changes are tracked per entity as a mask of `snapshot::Field` bits, so
+// networking and rendering can look at modified entities only.
+
+namespace robo {
+
+// Generations start at 1, so a default constructed handle is never live
+struct Handle
+{
+    uint32_t index = 0;
+    uint32_t generation = 0;
+
+    bool operator==(Handle const&) const = default;
+};
+
+// Entity id used on the wire: the handle index in the high bits and the
+// low bits of the generation below, so that a reused slot shows up as a
+// different entity. Ids still sort in index order, for up to 2^24 slots.
+constexpr int id_generation_bits = 8;
+
+inline uint32_t entity_id(Handle h)
+{
+    return (h.index << id_generation_bits) |
+           (h.generation & ((1U << id_generation_bits) - 1));
+}
+
+// Row storage shared by the entity tables. `Derived::columns()` returns a
+// tuple of references to the column vectors.
+template <typename Derived>
+class Table
+{
+public:
+    // Row -> handle of the entity in that row
+    std::vector<Handle> handles;
+    // Row -> fields changed since the last `clear_changes()`
+    std::vector<uint8_t> changed;
+
+    size_t size() const { return handles.size(); }
+
+    void mark(uint32_t row, uint8_t fields)
+    {
+        if (changed[row] == 0) dirty.push_back(handles[row]);
+        changed[row] |= fields;
+    }
+
+    // Handles of all entities marked since the last `clear_changes()`,
+    // possibly including some that have since been destroyed
+    std::vector<Handle> const& dirty_handles() const { return dirty; }
+
+    void clear_changes()
+    {
+        std::fill(changed.begin(), changed.end(), 0);
+        dirty.clear();
+    }
+
+protected:
+    uint32_t add_row(Handle h)
+    {
+        std::apply([](auto&... col) { (col.emplace_back(), ...); },
+                   self().columns());
+        handles.push_back(h);
+        changed.push_back(0);
+        auto row = static_cast<uint32_t>(handles.size() - 1);
+        mark(row, 0xff);
+        return row;
+    }
+
+    // Swap-remove; returns the handle of the entity that moved into `row`,
+    // if any
+    std::optional<Handle> remove_row(uint32_t row)
+    {
+        auto last = handles.size() - 1;
+        std::apply(
+            [&](auto&... col) {
+                ((col[row] = std::move(col[last]), col.pop_back()), ...);
+            },
+            self().columns());
+        handles[row] = handles[last];
+        changed[row] = changed[last];
+        handles.pop_back();
+        changed.pop_back();
+        if (row == handles.size()) return std::nullopt;
+        return handles[row];
+    }
+
+private:
+    Derived& self() { return static_cast<Derived&>(*this); }
+    std::vector<Handle> dirty;
+
+    friend class EntityStore;
+};
+
+struct Robots : Table<Robots>
+{
+    std::vector<int32_t> x;
+    std::vector<int32_t> y;
+    std::vector<uint8_t> head;
+    std::vector<uint16_t> hp;
+    std::vector<uint32_t> owner;
+    std::vector<Orders> orders;
+    // Number of each `Upgrade` taken, 8 bits per upgrade
+    std::vector<uint32_t> upgrades;
+
+    auto columns() { return std::tie(x, y, head, hp, owner, orders, upgrades); }
+    auto columns() const
+    {
+        return std::tie(x, y, head, hp, owner, orders, upgrades);
+    }
+};
+
+struct Projectiles : Table<Projectiles>
+{
+    std::vector<int32_t> x;
+    std::vector<int32_t> y;
+    std::vector<uint8_t> dir;
+    std::vector<uint16_t> damage;
+    std::vector<uint16_t> range_left;
+    std::vector<uint32_t> owner;
+
+    auto columns() { return std::tie(x, y, dir, damage, range_left, owner); }
+    auto columns() const
+    {
+        return std::tie(x, y, dir, damage, range_left, owner);
+    }
+};
+
+struct LootItems : Table<LootItems>
+{
+    std::vector<int32_t> x;
+    std::vector<int32_t> y;
+    std::vector<uint8_t> kind;
+
+    auto columns() { return std::tie(x, y, kind); }
+    auto columns() const { return std::tie(x, y, kind); }
+};
+
+class EntityStore
+{
+public:
+    Robots robots;
+    Projectiles projectiles;
+    LootItems loot;
+
+    // Where the entity with a given handle index lives
+    struct Slot
+    {
+        uint32_t generation = 1;
+        uint32_t row = 0;
+        EntityKind kind = EntityKind::Robot;
+        bool alive = false;
+    };
+
+    struct Location
+    {
+        EntityKind kind;
+        uint32_t row;
+    };
+
+    std::optional<Location> find(Handle h) const
+    {
+        if (h.index >= slots.size()) return std::nullopt;
+        auto const& s = slots[h.index];
+        if (!s.alive || s.generation != h.generation) return std::nullopt;
+        return Location{s.kind, s.row};
+    }
+
+    Handle add_robot(uint32_t owner, int32_t x, int32_t y, uint16_t hp)
+    {
+        auto h = allocate(EntityKind::Robot);
+        auto row = robots.add_row(h);
+        slots[h.index].row = row;
+        robots.owner[row] = owner;
+        robots.x[row] = x;
+        robots.y[row] = y;
+        robots.hp[row] = hp;
+        return h;
+    }
+
+    Handle add_projectile(uint32_t owner, int32_t x, int32_t y, uint8_t dir,
+                          uint16_t damage, uint16_t range)
+    {
+        auto h = allocate(EntityKind::Projectile);
+        auto row = projectiles.add_row(h);
+        slots[h.index].row = row;
+        projectiles.owner[row] = owner;
+        projectiles.x[row] = x;
+        projectiles.y[row] = y;
+        projectiles.dir[row] = dir;
+        projectiles.damage[row] = damage;
+        projectiles.range_left[row] = range;
+        return h;
+    }
+
+    Handle add_loot(int32_t x, int32_t y, uint8_t kind)
+    {
+        auto h = allocate(EntityKind::Loot);
+        auto row = loot.add_row(h);
+        slots[h.index].row = row;
+        loot.x[row] = x;
+        loot.y[row] = y;
+        loot.kind[row] = kind;
+        return h;
+    }
+
+    void destroy(Handle h)
+    {
+        auto loc = find(h);
+        if (!loc) return;
+        std::optional<Handle> moved;
+        switch (loc->kind) {
+        case EntityKind::Robot:
+            moved = robots.remove_row(loc->row);
+            break;
+        case EntityKind::Projectile:
+            moved = projectiles.remove_row(loc->row);
+            break;
+        case EntityKind::Loot:
+            moved = loot.remove_row(loc->row);
+            break;
+        }
+        if (moved) slots[moved->index].row = loc->row;
+        auto& s = slots[h.index];
+        s.alive = false;
+        // Skip 0 on wrap around, it is the null handle
+        if (++s.generation == 0) s.generation = 1;
+        free_slots.push_back(h.index);
+        removed_.push_back(h);
+    }
+
+    // Entities destroyed since the last `clear_changes()`
+    std::vector<Handle> const& removed() const { return removed_; }
+
+    void clear_changes()
+    {
+        robots.clear_changes();
+        projectiles.clear_changes();
+        loot.clear_changes();
+        removed_.clear();
+    }
+
+    std::span<Slot const> slot_list() const { return slots; }
+    std::span<uint32_t const> free_list() const { return free_slots; }
+
+    // Replace the handle table, as when restoring saved state. The tables
+    // must already hold the rows the slots refer to.
+    void restore(std::span<Slot const> slots_,
+                 std::span<uint32_t const> free_slots_)
+    {
+        slots.assign(slots_.begin(), slots_.end());
+        free_slots.assign(free_slots_.begin(), free_slots_.end());
+        clear_changes();
+    }
+
+    // Play action slot `step` for every robot
+    void step_robots(int step)
+    {
+        auto const n = robots.size();
+        for (uint32_t i = 0; i < n; i++) {
+            auto const& slot = robots.orders[i].slots[step];
+            if (slot.action == Action::Move) {
+                robots.x[i] += dir_x[slot.dir];
+                robots.y[i] += dir_y[slot.dir];
+                robots.mark(i, snapshot::X | snapshot::Y);
+            } else if (slot.action == Action::TurnHead &&
+                       robots.head[i] != slot.dir) {
+                robots.head[i] = slot.dir;
+                robots.mark(i, snapshot::Dir);
+            }
+        }
+    }
+
+    // Move all projectiles one cell, removing those out of range
+    void step_projectiles()
+    {
+        for (uint32_t i = 0; i < projectiles.size();) {
+            if (projectiles.range_left[i] == 0) {
+                destroy(projectiles.handles[i]);
+                continue;
+            }
+            projectiles.range_left[i]--;
+            projectiles.x[i] += dir_x[projectiles.dir[i]];
+            projectiles.y[i] += dir_y[projectiles.dir[i]];
+            projectiles.mark(i, snapshot::X | snapshot::Y);
+            i++;
+        }
+    }
+
+    // All entities in the form used by `SnapshotServer`, sorted on id (see
+    // `entity_id()`)
+    void export_states(std::vector<EntityState>& out) const
+    {
+        out.clear();
+        for (uint32_t i = 0; i < slots.size(); i++) {
+            auto const& s = slots[i];
+            if (!s.alive) continue;
+            EntityState e;
+            e.id = entity_id({i, s.generation});
+            e.kind = s.kind;
+            auto r = s.row;
+            switch (s.kind) {
+            case EntityKind::Robot:
+                e.x = robots.x[r];
+                e.y = robots.y[r];
+                e.dir = robots.head[r];
+                e.hp = robots.hp[r];
+                e.owner = robots.owner[r];
+                break;
+            case EntityKind::Projectile:
+                e.x = projectiles.x[r];
+                e.y = projectiles.y[r];
+                e.dir = projectiles.dir[r];
+                e.owner = projectiles.owner[r];
+                break;
+            case EntityKind::Loot:
+                e.x = loot.x[r];
+                e.y = loot.y[r];
+                e.dir = loot.kind[r];
+                break;
+            }
+            out.push_back(e);
+        }
+    }
+
+private:
+    Handle allocate(EntityKind kind)
+    {
+        uint32_t index = 0;
+        if (free_slots.empty()) {
+            index = static_cast<uint32_t>(slots.size());
+            slots.emplace_back();
+        } else {
+            index = free_slots.back();
+            free_slots.pop_back();
+        }
+        auto& s = slots[index];
+        s.alive = true;
+        s.kind = kind;
+        return {index, s.generation};
+    }
+
+    std::vector<Slot> slots;
+    std::vector<uint32_t> free_slots;
+    std::vector<Handle> removed_;
+};
+
+} // namespace robo
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "turn_protocol.h"
+
+#include <chrono>
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+namespace robo {
+
+// Server side lockstep barrier. Collects one submission per player for the
+// current turn; the turn is complete when every player has submitted or
+// the timeout has passed, whichever comes first.
+class TurnBarrier
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Player
+    {
+        uint32_t id = 0;
+        bool submitted = false;
+        // Turns this player has timed out in a row
+        int missed = 0;
+        std::vector<RobotOrders> robots;
+    };
+
+    enum class Result
+    {
+        Accepted,
+        Invalid,
+        UnknownPlayer,
+        WrongTurn,
+        Duplicate,
+    };
+
+    TurnBarrier(std::span<uint32_t const> player_ids, Clock::duration timeout_,
+                Clock::time_point now)
+        : timeout(timeout_), deadline_(now + timeout_)
+    {
+        players.reserve(player_ids.size());
+        for (auto id : player_ids) {
+            index[id] = players.size();
+            players.emplace_back().id = id;
+        }
+        waiting = players.size();
+    }
+
+    uint32_t turn() const { return turn_; }
+    Clock::time_point deadline() const { return deadline_; }
+    Clock::duration turn_timeout() const { return timeout; }
+    std::span<Player const> player_list() const { return players; }
+
+    // Replace all state, as when restoring a saved match
+    void restore(uint32_t turn, Clock::duration timeout_,
+                 Clock::time_point deadline, std::vector<Player> players_)
+    {
+        turn_ = turn;
+        timeout = timeout_;
+        deadline_ = deadline;
+        players = std::move(players_);
+        index.clear();
+        waiting = 0;
+        for (size_t i = 0; i < players.size(); i++) {
+            index[players[i].id] = i;
+            waiting += players[i].submitted ? 0 : 1;
+        }
+    }
+
+    // Submit `data` for `player`, which must come from the connection the
+    // data arrived on, never from the message itself. A message naming
+    // another player is rejected as invalid.
+    Result submit(uint32_t player, std::span<uint8_t const> data)
+    {
+        auto view = SubmissionView::parse(data);
+        if (!view || view->player() != player) return Result::Invalid;
+        auto it = index.find(player);
+        if (it == index.end()) return Result::UnknownPlayer;
+        if (view->turn() != turn_) return Result::WrongTurn;
+        auto& p = players[it->second];
+        if (p.submitted) return Result::Duplicate;
+        p.submitted = true;
+        p.missed = 0;
+        p.robots.assign(view->begin(), view->end());
+        waiting--;
+        return Result::Accepted;
+    }
+
+    bool ready(Clock::time_point now) const
+    {
+        return waiting == 0 || now >= deadline_;
+    }
+
+    // Finish the current turn if it is ready. Calls `fn` with the list of
+    // players (those that did not submit in time have no robot orders),
+    // then starts collecting the next turn.
+    template <typename FN>
+    bool complete(Clock::time_point now, FN const& fn)
+    {
+        if (!ready(now)) return false;
+        for (auto& p : players) {
+            if (!p.submitted) {
+                p.missed++;
+                p.robots.clear();
+            }
+        }
+        fn(std::span<Player const>(players));
+        for (auto& p : players) {
+            p.submitted = false;
+        }
+        waiting = players.size();
+        turn_++;
+        deadline_ = now + timeout;
+        return true;
+    }
+
+private:
+    Clock::duration timeout;
+    Clock::time_point deadline_;
+    uint32_t turn_ = 0;
+    std::vector<Player> players;
+    std::unordered_map<uint32_t, size_t> index;
+    size_t waiting = 0;
+};
+
+} // namespace robo
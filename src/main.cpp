@@ -1,4 +1,9 @@
+#include "main_loop.h"
+
+#include <chrono>
 #include <memory>
+#include <string_view>
+#include <thread>
 
 #include <ansi/console.h>
 #include <ansi/terminal.h>
@@ -45,22 +50,43 @@ struct Game
     Game()
     {
         init();
-        con->write("Welcome");
+        write("Welcome");
     }
 
     bool quit = false;
+    // Set when the console has changed and needs to be rendered again
+    bool dirty = true;
+
+    // All console output goes through here so the next frame is rendered
+    void write(std::string_view text)
+    {
+        con->write(text);
+        dirty = true;
+    }
 
     void run()
     {
-        while(!quit) {
+        using namespace std::chrono_literals;
+        MainLoop loop;
+        loop.poll = [&] {
             sys->handle_events(
-                Overload{[this](QuitEvent) { quit = true; },
-                         [&](TextEvent const& te) { },
+                Overload{[&](QuitEvent) { quit = loop.quit = true; },
+                         [&](TextEvent const& te) {},
                          [&](auto) {}});
-
-            con->render(context.get(), {0,0}, {-1,-1});
+        };
+        // We have no way to block on window events, so wake up often enough
+        // to keep input responsive.
+        loop.wait = [](MainLoop::Duration timeout) {
+            std::this_thread::sleep_for(
+                std::min<MainLoop::Duration>(timeout, 10ms));
+        };
+        loop.dirty = [&] { return dirty; };
+        loop.render = [&] {
+            con->render(context.get(), {0, 0}, {-1, -1});
             screen->swap();
-        }
+            dirty = false;
+        };
+        loop.run();
     }
 };
 
@@ -78,10 +104,20 @@ void run_terminal()
     auto term = bbs::create_local_terminal();
     auto con = std::make_shared<bbs::Console<>>(std::move(term));
     con->put("Hello");
-    con->flush();
 
-    uint32_t key = 0;
-    while (key == 0) {
-        key = con->read_key();
-    }
+    MainLoop loop;
+    loop.wait = [&](MainLoop::Duration timeout) {
+        using namespace std::chrono;
+        con->wait_key(timeout == MainLoop::forever
+                          ? -1
+                          : static_cast<int>(
+                                ceil<milliseconds>(timeout).count()));
+    };
+    loop.poll = [&] {
+        con->check_resize();
+        if (con->wait_key(0) && con->read_key() != 0) loop.quit = true;
+    };
+    loop.dirty = [&] { return con->dirty; };
+    loop.render = [&] { con->flush(); };
+    loop.run();
 }
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+
+// Runs the simulation at a fixed timestep, independent of rendering.
+// Redraws only when something is dirty, at most once per `frame`, and
+// blocks in `wait` when there is nothing to do.
+class MainLoop
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using Duration = Clock::duration;
+
+    static constexpr Duration forever = Duration::max();
+
+    // Length of one simulation step
+    Duration step = std::chrono::milliseconds(50);
+    // Minimum time between two redraws
+    Duration frame = std::chrono::microseconds(16667);
+    // Steps to run before giving up on catching up with the clock
+    int max_steps = 5;
+
+    // Block until input is ready or `timeout` has passed
+    std::function<void(Duration timeout)> wait;
+    // Handle all pending input
+    std::function<void()> poll;
+    // Advance simulation one step
+    std::function<void()> update;
+    // True while the simulation needs to be stepped
+    std::function<bool()> simulating;
+    // True if the screen needs to be redrawn
+    std::function<bool()> dirty;
+    std::function<void()> render;
+
+    bool quit = false;
+
+    void run()
+    {
+        auto now = Clock::now();
+        auto next_step = now;
+        auto next_frame = now;
+        bool was_simulating = false;
+
+        while (!quit) {
+            if (poll) poll();
+            now = Clock::now();
+
+            bool const sim = update && simulating && simulating();
+            if (sim) {
+                if (!was_simulating) next_step = now;
+                int steps = 0;
+                while (next_step <= now && steps++ < max_steps) {
+                    update();
+                    next_step += step;
+                }
+                // Too far behind; drop the time instead of spiraling
+                if (next_step <= now) next_step = now + step;
+            }
+            was_simulating = sim;
+
+            bool redraw = dirty && dirty();
+            if (redraw && next_frame <= now) {
+                render();
+                next_frame = now + frame;
+                redraw = dirty();
+            }
+            if (quit) break;
+
+            auto deadline = Clock::time_point::max();
+            if (sim) deadline = next_step;
+            if (redraw) deadline = std::min(deadline, next_frame);
+
+            now = Clock::now();
+            if (deadline == Clock::time_point::max()) {
+                wait(forever);
+            } else if (deadline > now) {
+                wait(deadline - now);
+            }
+        }
+    }
+};
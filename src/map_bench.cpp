@@ -0,0 +1,47 @@
+// Map generation throughput. Generates N x N chunks on one thread and
+// then on all cores, and reports cells per second.
+//
+//   robo_map_bench [-n chunks per side] [-s seed]
+
+#include "map_gen.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+using namespace robo;
+
+int main(int argc, char** argv)
+{
+    int32_t n = 32;
+    uint64_t seed = 1;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string const arg = argv[i];
+        if (arg == "-n") {
+            n = std::max(std::atoi(argv[i + 1]), 1);
+        } else if (arg == "-s") {
+            seed = std::strtoull(argv[i + 1], nullptr, 10);
+        } else {
+            fprintf(stderr, "usage: %s [-n chunks per side] [-s seed]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    auto const cores = std::max(std::thread::hardware_concurrency(), 1U);
+    auto const cells = static_cast<double>(n) * n * chunk_size * chunk_size;
+    for (unsigned threads : {1U, cores}) {
+        Map map(seed);
+        auto t0 = std::chrono::steady_clock::now();
+        map.generate(-n / 2, -n / 2, n - n / 2, n - n / 2, threads);
+        double const secs = std::chrono::duration<double>(
+                                std::chrono::steady_clock::now() - t0)
+                                .count();
+        printf("%d x %d chunks on %u thread(s): %.3fs, %.0f cells/s\n", n, n,
+               threads, secs, cells / secs);
+    }
+    return 0;
+}
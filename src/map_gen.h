@@ -0,0 +1,403 @@
+#pragma once
+
+#include "parallel.h"
+#include "random.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Procedural map generation. The world is made of square chunks that are
+// generated independently; the contents of a chunk depend only on the
+// seed and the chunk coordinate, so chunks can be generated in any order,
+// in parallel, or lazily when first needed.
+
+namespace robo {
+
+enum class Cell : uint8_t
+{
+    Ground,
+    Floor,
+    Wall,
+    Door,
+    Rock,
+    Water,
+    Tree,
+};
+
+inline bool walkable(Cell c)
+{
+    return c == Cell::Ground || c == Cell::Floor || c == Cell::Door;
+}
+
+constexpr int32_t chunk_size = 64;
+
+// Room interior, in world coordinates
+struct Room
+{
+    int32_t x;
+    int32_t y;
+    int32_t w;
+    int32_t h;
+};
+
+struct Loot
+{
+    int32_t x;
+    int32_t y;
+    uint8_t kind;
+};
+
+struct Chunk
+{
+    int32_t cx = 0;
+    int32_t cy = 0;
+    bool indoor = false;
+    std::array<Cell, chunk_size * chunk_size> cells{};
+    std::vector<Room> rooms;
+    std::vector<Loot> loot;
+
+    Cell& at(int32_t x, int32_t y) { return cells[x + y * chunk_size]; }
+    Cell at(int32_t x, int32_t y) const { return cells[x + y * chunk_size]; }
+};
+
+class MapGenerator
+{
+public:
+    // Percentage of chunks that contain a building
+    uint32_t indoor_percent = 40;
+    // Smallest room side, not counting walls
+    int32_t min_room = 4;
+    uint32_t loot_kinds = 4;
+
+    explicit MapGenerator(uint64_t seed_) : seed(seed_) {}
+
+    bool is_indoor(int32_t cx, int32_t cy) const
+    {
+        return hash_seed(seed, cx, cy) % 100 < indoor_percent;
+    }
+
+    void generate(Chunk& chunk, int32_t cx, int32_t cy) const
+    {
+        chunk.cx = cx;
+        chunk.cy = cy;
+        chunk.indoor = is_indoor(cx, cy);
+        chunk.rooms.clear();
+        chunk.loot.clear();
+
+        Rng rng(hash_seed(seed, cx, cy));
+        terrain(chunk, rng);
+        if (chunk.indoor) building(chunk, rng);
+        place_loot(chunk, rng);
+    }
+
+private:
+    static constexpr int32_t lattice = 16;
+
+    // Outdoor terrain from value noise over world coordinates, so it
+    // lines up across chunk borders
+    void terrain(Chunk& chunk, Rng& rng) const
+    {
+        constexpr int32_t n = chunk_size / lattice + 1;
+        std::array<uint32_t, n * n> corners; // NOLINT
+        for (int32_t y = 0; y < n; y++) {
+            for (int32_t x = 0; x < n; x++) {
+                auto h = hash_seed(seed ^ 0x7e11a1, chunk.cx * (n - 1) + x,
+                                   chunk.cy * (n - 1) + y);
+                corners[x + y * n] = static_cast<uint32_t>(h & 0xffff);
+            }
+        }
+        for (int32_t y = 0; y < chunk_size; y++) {
+            auto ly = y / lattice;
+            auto fy = y % lattice;
+            for (int32_t x = 0; x < chunk_size; x++) {
+                auto lx = x / lattice;
+                auto fx = x % lattice;
+                auto const* c = &corners[lx + ly * n];
+                auto top = c[0] * (lattice - fx) + c[1] * fx;
+                auto bottom = c[n] * (lattice - fx) + c[n + 1] * fx;
+                auto v = (top * (lattice - fy) + bottom * fy) /
+                         (lattice * lattice);
+                auto& cell = chunk.at(x, y);
+                if (v < 0x2800) {
+                    cell = Cell::Water;
+                } else if (v > 0xd800) {
+                    cell = Cell::Rock;
+                } else {
+                    cell = rng.chance(4) ? Cell::Tree : Cell::Ground;
+                }
+            }
+        }
+    }
+
+    struct Rect
+    {
+        int32_t x0;
+        int32_t y0;
+        int32_t x1; // Exclusive
+        int32_t y1;
+    };
+
+    struct Split
+    {
+        bool vertical;
+        int32_t pos;
+        int32_t from;
+        int32_t to;
+    };
+
+    void building(Chunk& chunk, Rng& rng) const
+    {
+        // Leave a margin of ground so buildings never touch each other
+        Rect const outer{rng.range(2, 6), rng.range(2, 6),
+                         chunk_size - rng.range(2, 6),
+                         chunk_size - rng.range(2, 6)};
+        for (int32_t y = outer.y0; y < outer.y1; y++) {
+            for (int32_t x = outer.x0; x < outer.x1; x++) {
+                bool const edge = x == outer.x0 || y == outer.y0 ||
+                                  x == outer.x1 - 1 || y == outer.y1 - 1;
+                chunk.at(x, y) = edge ? Cell::Wall : Cell::Floor;
+            }
+        }
+        // Clear a path around the building
+        for (int32_t y = outer.y0 - 1; y <= outer.y1; y++) {
+            for (int32_t x = outer.x0 - 1; x <= outer.x1; x++) {
+                if (x == outer.x0 - 1 || y == outer.y0 - 1 || x == outer.x1 ||
+                    y == outer.y1) {
+                    chunk.at(x, y) = Cell::Ground;
+                }
+            }
+        }
+
+        std::vector<Split> splits;
+        std::vector<Rect> leaves;
+        std::vector<Rect> todo{
+            {outer.x0 + 1, outer.y0 + 1, outer.x1 - 1, outer.y1 - 1}};
+        while (!todo.empty()) {
+            auto r = todo.back();
+            todo.pop_back();
+            auto w = r.x1 - r.x0;
+            auto h = r.y1 - r.y0;
+            bool const can_v = w >= min_room * 2 + 1;
+            bool const can_h = h >= min_room * 2 + 1;
+            // Large enough rooms are sometimes left alone
+            if ((!can_v && !can_h) ||
+                (w < min_room * 3 && h < min_room * 3 && rng.chance(30))) {
+                leaves.push_back(r);
+                continue;
+            }
+            bool const vertical = can_v && (!can_h || w > h ||
+                                            (w == h && rng.chance(50)));
+            if (vertical) {
+                auto pos = rng.range(r.x0 + min_room, r.x1 - min_room - 1);
+                for (int32_t y = r.y0; y < r.y1; y++) {
+                    chunk.at(pos, y) = Cell::Wall;
+                }
+                splits.push_back({true, pos, r.y0, r.y1});
+                todo.push_back({r.x0, r.y0, pos, r.y1});
+                todo.push_back({pos + 1, r.y0, r.x1, r.y1});
+            } else {
+                auto pos = rng.range(r.y0 + min_room, r.y1 - min_room - 1);
+                for (int32_t x = r.x0; x < r.x1; x++) {
+                    chunk.at(x, pos) = Cell::Wall;
+                }
+                splits.push_back({false, pos, r.x0, r.x1});
+                todo.push_back({r.x0, r.y0, r.x1, pos});
+                todo.push_back({r.x0, pos + 1, r.x1, r.y1});
+            }
+        }
+
+        // Both sides of every split are connected inside, so one door with
+        // floor on both sides of each split wall connects all rooms.
+        std::vector<std::pair<int32_t, int32_t>> candidates;
+        for (auto const& s : splits) {
+            candidates.clear();
+            for (auto i = s.from; i < s.to; i++) {
+                auto x = s.vertical ? s.pos : i;
+                auto y = s.vertical ? i : s.pos;
+                auto dx = s.vertical ? 1 : 0;
+                auto dy = s.vertical ? 0 : 1;
+                if (chunk.at(x - dx, y - dy) == Cell::Floor &&
+                    chunk.at(x + dx, y + dy) == Cell::Floor) {
+                    candidates.emplace_back(x, y);
+                }
+            }
+            if (!candidates.empty()) {
+                auto [x, y] = candidates[rng.below(candidates.size())];
+                chunk.at(x, y) = Cell::Door;
+            }
+        }
+
+        // One or two doors to the outside
+        auto doors = rng.range(1, 2);
+        for (int i = 0; i < doors; i++) {
+            for (int tries = 0; tries < 32; tries++) {
+                bool const vertical = rng.chance(50);
+                bool const far = rng.chance(50);
+                auto x = vertical ? (far ? outer.x1 - 1 : outer.x0)
+                                  : rng.range(outer.x0 + 1, outer.x1 - 2);
+                auto y = vertical ? rng.range(outer.y0 + 1, outer.y1 - 2)
+                                  : (far ? outer.y1 - 1 : outer.y0);
+                auto ix = vertical ? (far ? x - 1 : x + 1) : x;
+                auto iy = vertical ? y : (far ? y - 1 : y + 1);
+                if (chunk.at(ix, iy) == Cell::Floor) {
+                    chunk.at(x, y) = Cell::Door;
+                    break;
+                }
+            }
+        }
+
+        for (auto const& r : leaves) {
+            chunk.rooms.push_back({chunk.cx * chunk_size + r.x0,
+                                   chunk.cy * chunk_size + r.y0, r.x1 - r.x0,
+                                   r.y1 - r.y0});
+        }
+    }
+
+    // Loot is only found outdoors
+    void place_loot(Chunk& chunk, Rng& rng) const
+    {
+        auto count = chunk.indoor ? rng.range(0, 1) : rng.range(2, 6);
+        for (int32_t i = 0, tries = 0; i < count && tries < 64; tries++) {
+            auto x = rng.range(0, chunk_size - 1);
+            auto y = rng.range(0, chunk_size - 1);
+            if (chunk.at(x, y) != Cell::Ground) continue;
+            chunk.loot.push_back({chunk.cx * chunk_size + x,
+                                  chunk.cy * chunk_size + y,
+                                  static_cast<uint8_t>(rng.below(loot_kinds))});
+            i++;
+        }
+    }
+
+    uint64_t seed;
+};
+
+// Chunks generated on demand. Not thread safe; use `generate()` to fill an
+// area in parallel up front.
+class Map
+{
+public:
+    explicit Map(uint64_t seed) : generator(seed) {}
+
+    MapGenerator generator;
+
+    Chunk const& chunk(int32_t cx, int32_t cy)
+    {
+        auto& c = chunks[key(cx, cy)];
+        if (c == nullptr) {
+            c = std::make_unique<Chunk>();
+            generator.generate(*c, cx, cy);
+        }
+        return *c;
+    }
+
+    Cell at(int32_t x, int32_t y)
+    {
+        auto cx = floor_div(x);
+        auto cy = floor_div(y);
+        return chunk(cx, cy).at(x - cx * chunk_size, y - cy * chunk_size);
+    }
+
+    bool has_chunk(int32_t cx, int32_t cy) const
+    {
+        return chunks.contains(key(cx, cy));
+    }
+
+    size_t chunk_count() const { return chunks.size(); }
+
+    // Call `fn` for every generated chunk, in no particular order
+    template <typename FN>
+    void for_each_chunk(FN const& fn) const
+    {
+        for (auto const& [k, c] : chunks) {
+            fn(*c);
+        }
+    }
+
+    // Add an empty chunk without generating it, replacing any existing
+    // one. Used when restoring saved state.
+    Chunk& insert(int32_t cx, int32_t cy)
+    {
+        auto& c = chunks[key(cx, cy)];
+        c = std::make_unique<Chunk>();
+        c->cx = cx;
+        c->cy = cy;
+        return *c;
+    }
+
+    // Generate all missing chunks with cx0 <= cx < cx1, cy0 <= cy < cy1
+    // on `threads` threads (0 = one per core)
+    void generate(int32_t cx0, int32_t cy0, int32_t cx1, int32_t cy1,
+                  unsigned threads = 0)
+    {
+        std::vector<std::unique_ptr<Chunk>> todo;
+        for (auto cy = cy0; cy < cy1; cy++) {
+            for (auto cx = cx0; cx < cx1; cx++) {
+                if (!has_chunk(cx, cy)) {
+                    todo.push_back(std::make_unique<Chunk>());
+                    todo.back()->cx = cx;
+                    todo.back()->cy = cy;
+                }
+            }
+        }
+        parallel_for(todo.size(), threads, [&](size_t i, unsigned) {
+            auto& c = *todo[i];
+            generator.generate(c, c.cx, c.cy);
+        });
+        for (auto& c : todo) {
+            auto k = key(c->cx, c->cy);
+            chunks[k] = std::move(c);
+        }
+    }
+
+    // Up to `count` spawn points, each in the first room of a different
+    // building, picked from the buildings closest to the origin.
+    std::vector<std::pair<int32_t, int32_t>> spawn_points(size_t count,
+                                                          int32_t max_ring = 64)
+    {
+        std::vector<std::pair<int32_t, int32_t>> result;
+        auto visit = [&](int32_t cx, int32_t cy) {
+            if (result.size() >= count || !generator.is_indoor(cx, cy)) {
+                return;
+            }
+            auto const& c = chunk(cx, cy);
+            if (c.rooms.empty()) return;
+            auto const& r = c.rooms.front();
+            result.emplace_back(r.x + r.w / 2, r.y + r.h / 2);
+        };
+        for (int32_t ring = 0; ring <= max_ring && result.size() < count;
+             ring++) {
+            if (ring == 0) {
+                visit(0, 0);
+                continue;
+            }
+            for (auto i = -ring; i < ring; i++) {
+                visit(i, -ring);
+                visit(ring, i);
+                visit(-i, ring);
+                visit(-ring, -i);
+            }
+        }
+        return result;
+    }
+
+private:
+    static int32_t floor_div(int32_t v)
+    {
+        return v >= 0 ? v / chunk_size : (v + 1) / chunk_size - 1;
+    }
+
+    static uint64_t key(int32_t cx, int32_t cy)
+    {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(cx)) << 32) |
+               static_cast<uint32_t>(cy);
+    }
+
+    std::unordered_map<uint64_t, std::unique_ptr<Chunk>> chunks;
+};
+
+} // namespace robo
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "entities.h"
+#include "lockstep.h"
+#include "map_gen.h"
+#include "random.h"
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace robo {
+
+// Cards of one robot. The cards are shuffled in place and drawn from the
+// front; the deck is reshuffled once `drawn` reaches the end.
+struct Deck
+{
+    Handle robot;
+    std::vector<Action> cards;
+    uint32_t drawn = 0;
+};
+
+// Complete state of one running match on the server
+struct MatchState
+{
+    using Clock = TurnBarrier::Clock;
+
+    MatchState(uint64_t seed_, std::span<uint32_t const> player_ids,
+               Clock::duration timeout, Clock::time_point now)
+        : seed(seed_), map(seed_), rng(seed_), barrier(player_ids, timeout, now)
+    {}
+
+    uint64_t seed;
+    Map map;
+    EntityStore entities;
+    std::vector<Deck> decks;
+    Rng rng;
+    TurnBarrier barrier;
+};
+
+} // namespace robo
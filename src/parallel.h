@@ -0,0 +1,39 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace robo {
+
+// Call `fn(i, thread)` for every i in [0, count) on up to `threads`
+// threads (0 = one per core), including the calling one. Items are handed
+// out one at a time from a shared counter, so uneven items balance out.
+// `thread` is in [0, threads), for keeping per thread state.
+template <typename FN>
+void parallel_for(size_t count, unsigned threads, FN const& fn)
+{
+    if (threads == 0) {
+        threads = std::max(std::thread::hardware_concurrency(), 1U);
+    }
+    threads = static_cast<unsigned>(std::min<size_t>(threads, count));
+
+    std::atomic<size_t> next{0};
+    auto work = [&](unsigned t) {
+        for (auto i = next++; i < count; i = next++) {
+            fn(i, t);
+        }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; t++) {
+        pool.emplace_back(work, t);
+    }
+    work(0);
+    for (auto& t : pool) {
+        t.join();
+    }
+}
+
+} // namespace robo
@@ -0,0 +1,148 @@
+// Turn submission throughput. Encodes and decodes submissions in memory,
+// then sends them as frames over a socketpair and decodes them with
+// `FrameReader` on the other end.
+//
+//   robo_protocol_bench [-n submissions] [-r robots]
+
+#include "turn_protocol.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace robo;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double seconds_since(Clock::time_point t0)
+{
+    return std::chrono::duration<double>(Clock::now() - t0).count();
+}
+
+std::vector<RobotOrders> make_robots(uint32_t count)
+{
+    std::vector<RobotOrders> robots(count);
+    for (uint32_t i = 0; i < count; i++) {
+        auto& r = robots[i];
+        r.id = i * 3 + 1;
+        r.x = static_cast<int32_t>(i * 7) - 50;
+        r.y = static_cast<int32_t>(i * 11) - 20;
+        for (int s = 0; s < slot_count; s++) {
+            r.orders.slots[s] = {static_cast<Action>((i + s) % 4),
+                                 static_cast<uint8_t>((i * s) % 8)};
+        }
+        r.orders.reaction = static_cast<Reaction>(i % 3);
+    }
+    return robots;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    uint64_t count = 1000000;
+    uint32_t robot_count = 8;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string const arg = argv[i];
+        if (arg == "-n") {
+            count = std::strtoull(argv[i + 1], nullptr, 10);
+        } else if (arg == "-r") {
+            robot_count = std::atoi(argv[i + 1]);
+        } else {
+            fprintf(stderr, "usage: %s [-n submissions] [-r robots]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    auto const robots = make_robots(robot_count);
+    std::vector<uint8_t> buffer;
+    std::vector<RobotOrders> decoded;
+    decoded.reserve(robot_count);
+
+    // In memory
+    auto t0 = Clock::now();
+    for (uint64_t i = 0; i < count; i++) {
+        buffer.clear();
+        encode_submission(buffer, static_cast<uint32_t>(i), 1, robots);
+        auto view = SubmissionView::parse(buffer);
+        if (!view) {
+            fprintf(stderr, "Decode failed\n");
+            return 1;
+        }
+        decoded.assign(view->begin(), view->end());
+    }
+    auto secs = seconds_since(t0);
+    printf("memory:     %llu submissions (%u robots, %zu bytes) in %.3fs, "
+           "%.0f/s\n",
+           static_cast<unsigned long long>(count), robot_count, buffer.size(),
+           secs, static_cast<double>(count) / secs);
+
+    // Over a socketpair, writer on its own thread
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        perror("socketpair");
+        return 1;
+    }
+    t0 = Clock::now();
+    std::thread writer([&] {
+        std::vector<uint8_t> message;
+        std::vector<uint8_t> out;
+        for (uint64_t i = 0; i < count; i++) {
+            message.clear();
+            encode_submission(message, static_cast<uint32_t>(i), 1, robots);
+            FrameReader::write_frame(out, message);
+            if (out.size() >= 16384 || i + 1 == count) {
+                size_t done = 0;
+                while (done < out.size()) {
+                    auto n = send(fds[0], out.data() + done,
+                                  out.size() - done, MSG_NOSIGNAL);
+                    if (n <= 0) return;
+                    done += n;
+                }
+                out.clear();
+            }
+        }
+        close(fds[0]);
+    });
+
+    FrameReader reader;
+    std::vector<uint8_t> data(65536);
+    uint64_t received = 0;
+    bool failed = false;
+    while (!failed) {
+        auto n = read(fds[1], data.data(), data.size());
+        if (n <= 0) break;
+        reader.feed({data.data(), static_cast<size_t>(n)});
+        while (auto frame = reader.next()) {
+            auto view = SubmissionView::parse(*frame);
+            if (!view || view->turn() != received) {
+                failed = true;
+                break;
+            }
+            decoded.assign(view->begin(), view->end());
+            received++;
+        }
+        failed = failed || reader.error;
+    }
+    close(fds[1]);
+    writer.join();
+    secs = seconds_since(t0);
+    if (failed || received != count) {
+        fprintf(stderr, "Socket stream failed after %llu submissions\n",
+                static_cast<unsigned long long>(received));
+        return 1;
+    }
+    printf("socketpair: %llu submissions in %.3fs, %.0f/s\n",
+           static_cast<unsigned long long>(received), secs,
+           static_cast<double>(received) / secs);
+    return 0;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+
+namespace robo {
+
+inline uint64_t splitmix64(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// Mix a seed with coordinates (or any other values) into a new seed
+inline uint64_t hash_seed(uint64_t seed, int64_t a, int64_t b = 0)
+{
+    return splitmix64(splitmix64(seed ^ static_cast<uint64_t>(a)) ^
+                      static_cast<uint64_t>(b));
+}
+
+// Small, fast generator (xoshiro256**). Copyable, so that the state can
+// be saved and restored.
+struct Rng
+{
+    uint64_t s[4];
+
+    explicit Rng(uint64_t seed = 0) { reseed(seed); }
+
+    void reseed(uint64_t seed)
+    {
+        for (auto& v : s) {
+            seed = splitmix64(seed);
+            v = seed;
+        }
+    }
+
+    uint64_t next()
+    {
+        auto const result = rotl(s[1] * 5, 7) * 9;
+        auto const t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return result;
+    }
+
+    // Uniform in [0, n)
+    uint32_t below(uint32_t n)
+    {
+        return static_cast<uint32_t>(((next() >> 32) * n) >> 32);
+    }
+
+    // Uniform in [lo, hi]
+    int32_t range(int32_t lo, int32_t hi)
+    {
+        return lo + static_cast<int32_t>(below(hi - lo + 1));
+    }
+
+    bool chance(uint32_t percent) { return below(100) < percent; }
+
+private:
+    static uint64_t rotl(uint64_t x, int k)
+    {
+        return (x << k) | (x >> (64 - k));
+    }
+};
+
+} // namespace robo
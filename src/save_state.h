@@ -0,0 +1,729 @@
+#pragma once
+
+#include "match.h"
+#include "parallel.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Binary save state for running matches, for restarting a server without
+// losing them.
+//
+// A save is a header followed by flat arrays of fixed size records. All
+// references are byte offsets from the start of the save and every array
+// is 8 byte aligned, so a save can be mapped into memory and read in
+// place. Entity tables are stored one column at a time, the same way
+// `EntityStore` keeps them, so loading them is a copy per column.
+//
+// Numbers are stored in native byte order; a save is for restarting on
+// the same kind of machine, not for keeping.
+
+namespace robo::save {
+
+constexpr std::array<char, 8> magic{'R', 'O', 'B', 'O', 'S', 'A', 'V', 'E'};
+constexpr uint32_t version = 1;
+
+// Byte range, relative to the start of the save
+struct Ref
+{
+    uint64_t offset = 0;
+    uint64_t size = 0;
+};
+
+struct ChunkRecord
+{
+    int32_t cx;
+    int32_t cy;
+    // Ranges in `Header::rooms` and `Header::loot`
+    uint32_t first_room;
+    uint32_t room_count;
+    uint32_t first_loot;
+    uint32_t loot_count;
+    uint32_t indoor;
+    std::array<Cell, chunk_size * chunk_size> cells;
+};
+
+struct SlotRecord
+{
+    uint32_t generation;
+    uint32_t row;
+    EntityKind kind;
+    uint8_t alive;
+    uint16_t reserved;
+};
+
+struct TableRecord
+{
+    uint64_t rows;
+    Ref handles;
+    // One per column, in `columns()` order
+    std::array<Ref, 8> columns;
+};
+
+struct DeckRecord
+{
+    Handle robot;
+    uint32_t drawn;
+    // Range in `Header::cards`
+    uint32_t first_card;
+    uint32_t card_count;
+};
+
+struct PlayerRecord
+{
+    uint32_t id;
+    uint32_t submitted;
+    int32_t missed;
+    // Range in `Header::orders`
+    uint32_t first_robot;
+    uint32_t robot_count;
+};
+
+struct OrdersRecord
+{
+    uint32_t id;
+    int32_t x;
+    int32_t y;
+    // See `pack_orders()`
+    uint32_t orders;
+};
+
+struct Header
+{
+    std::array<char, 8> magic;
+    uint32_t version;
+    uint32_t turn;
+    // Size of the whole save
+    uint64_t size;
+    uint64_t seed;
+    std::array<uint64_t, 4> rng;
+    int64_t timeout_us;
+    // Time left of the current turn when saved
+    int64_t remaining_us;
+
+    Ref chunks;
+    Ref rooms;
+    Ref loot;
+
+    Ref slots;
+    Ref free_slots;
+    TableRecord robots;
+    TableRecord projectiles;
+    TableRecord loot_items;
+
+    Ref decks;
+    Ref cards;
+
+    Ref players;
+    Ref orders;
+};
+
+namespace detail {
+
+inline bool in_range(uint32_t first, uint32_t count, size_t size)
+{
+    return first <= size && count <= size - first;
+}
+
+// Make room for `count` records at the end of `out`
+template <typename T>
+Ref reserve(std::vector<uint8_t>& out, size_t count)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    Ref r{(out.size() + 7) & ~size_t{7}, count * sizeof(T)};
+    out.resize(r.offset + r.size);
+    return r;
+}
+
+template <typename T>
+void put(std::vector<uint8_t>& out, Ref r, size_t i, T const& value)
+{
+    std::memcpy(out.data() + r.offset + i * sizeof(T), &value, sizeof(T));
+}
+
+template <typename T>
+Ref append(std::vector<uint8_t>& out, std::span<T const> data)
+{
+    auto r = reserve<T>(out, data.size());
+    if (!data.empty()) std::memcpy(out.data() + r.offset, data.data(), r.size);
+    return r;
+}
+
+template <typename TABLE>
+TableRecord put_table(std::vector<uint8_t>& out, TABLE const& table)
+{
+    static_assert(std::tuple_size_v<decltype(table.columns())> <= 8);
+    TableRecord rec{};
+    rec.rows = table.size();
+    rec.handles = append(out, std::span(table.handles));
+    size_t i = 0;
+    std::apply(
+        [&](auto const&... col) {
+            ((rec.columns[i++] = append(out, std::span(col))), ...);
+        },
+        table.columns());
+    return rec;
+}
+
+} // namespace detail
+
+// Serialize `m` into `out`, replacing its contents. Reusing the same
+// buffer for every save avoids allocating once it has grown to size.
+inline void save_match(MatchState const& m, std::vector<uint8_t>& out,
+                       MatchState::Clock::time_point now)
+{
+    using namespace detail;
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+
+    Header h{};
+    h.magic = magic;
+    h.version = version;
+    h.turn = m.barrier.turn();
+    h.seed = m.seed;
+    std::copy(std::begin(m.rng.s), std::end(m.rng.s), h.rng.begin());
+    h.timeout_us =
+        duration_cast<microseconds>(m.barrier.turn_timeout()).count();
+    h.remaining_us = std::max<int64_t>(
+        duration_cast<microseconds>(m.barrier.deadline() - now).count(), 0);
+
+    out.clear();
+    out.resize(sizeof(Header));
+
+    // Chunks, with the rooms and loot of all chunks in two shared arrays
+    size_t room_count = 0;
+    size_t loot_count = 0;
+    m.map.for_each_chunk([&](Chunk const& c) {
+        room_count += c.rooms.size();
+        loot_count += c.loot.size();
+    });
+    h.chunks = reserve<ChunkRecord>(out, m.map.chunk_count());
+    h.rooms = reserve<Room>(out, room_count);
+    h.loot = reserve<Loot>(out, loot_count);
+    uint32_t ci = 0;
+    uint32_t ri = 0;
+    uint32_t li = 0;
+    m.map.for_each_chunk([&](Chunk const& c) {
+        ChunkRecord rec; // NOLINT
+        rec.cx = c.cx;
+        rec.cy = c.cy;
+        rec.first_room = ri;
+        rec.room_count = static_cast<uint32_t>(c.rooms.size());
+        rec.first_loot = li;
+        rec.loot_count = static_cast<uint32_t>(c.loot.size());
+        rec.indoor = c.indoor ? 1 : 0;
+        rec.cells = c.cells;
+        put(out, h.chunks, ci++, rec);
+        for (auto const& r : c.rooms) {
+            put(out, h.rooms, ri++, r);
+        }
+        for (auto const& l : c.loot) {
+            put(out, h.loot, li++, l);
+        }
+    });
+
+    // Entities
+    auto const& e = m.entities;
+    auto slots = e.slot_list();
+    h.slots = reserve<SlotRecord>(out, slots.size());
+    for (size_t i = 0; i < slots.size(); i++) {
+        auto const& s = slots[i];
+        put(out, h.slots, i,
+            SlotRecord{s.generation, s.row, s.kind,
+                       static_cast<uint8_t>(s.alive ? 1 : 0), 0});
+    }
+    h.free_slots = append(out, e.free_list());
+    h.robots = put_table(out, e.robots);
+    h.projectiles = put_table(out, e.projectiles);
+    h.loot_items = put_table(out, e.loot);
+
+    // Decks
+    size_t card_count = 0;
+    for (auto const& d : m.decks) {
+        card_count += d.cards.size();
+    }
+    h.decks = reserve<DeckRecord>(out, m.decks.size());
+    h.cards = reserve<Action>(out, card_count);
+    uint32_t card = 0;
+    for (size_t i = 0; i < m.decks.size(); i++) {
+        auto const& d = m.decks[i];
+        auto n = static_cast<uint32_t>(d.cards.size());
+        put(out, h.decks, i, DeckRecord{d.robot, d.drawn, card, n});
+        if (n > 0) {
+            std::memcpy(out.data() + h.cards.offset + card, d.cards.data(),
+                        n);
+        }
+        card += n;
+    }
+
+    // Turn barrier
+    auto players = m.barrier.player_list();
+    size_t order_count = 0;
+    for (auto const& p : players) {
+        order_count += p.robots.size();
+    }
+    h.players = reserve<PlayerRecord>(out, players.size());
+    h.orders = reserve<OrdersRecord>(out, order_count);
+    uint32_t order = 0;
+    for (size_t i = 0; i < players.size(); i++) {
+        auto const& p = players[i];
+        auto n = static_cast<uint32_t>(p.robots.size());
+        put(out, h.players, i,
+            PlayerRecord{p.id, p.submitted ? 1U : 0U,
+                         static_cast<int32_t>(p.missed), order, n});
+        for (auto const& r : p.robots) {
+            put(out, h.orders, order++,
+                OrdersRecord{r.id, r.x, r.y, pack_orders(r.orders)});
+        }
+    }
+
+    h.size = out.size();
+    std::memcpy(out.data(), &h, sizeof(h));
+}
+
+// Read only access to a save in memory, typically a `MappedFile`
+class View
+{
+public:
+    // Check the header; nullopt if `data` is not a save of this version
+    static std::optional<View> open(std::span<uint8_t const> data)
+    {
+        if (data.size() < sizeof(Header) ||
+            reinterpret_cast<uintptr_t>(data.data()) % alignof(Header) != 0) {
+            return std::nullopt;
+        }
+        View v;
+        v.data = data;
+        v.head = reinterpret_cast<Header const*>(data.data());
+        if (v.head->magic != magic || v.head->version != version ||
+            v.head->size != data.size()) {
+            return std::nullopt;
+        }
+        return v;
+    }
+
+    Header const& header() const { return *head; }
+
+    // The records in `r`, in place; nullopt if `r` is not a valid range
+    template <typename T>
+    std::optional<std::span<T const>> get(Ref r) const
+    {
+        if (r.offset % alignof(T) != 0 || r.size % sizeof(T) != 0 ||
+            r.offset > data.size() || r.size > data.size() - r.offset) {
+            return std::nullopt;
+        }
+        return std::span(reinterpret_cast<T const*>(data.data() + r.offset),
+                         r.size / sizeof(T));
+    }
+
+private:
+    View() = default;
+    std::span<uint8_t const> data;
+    Header const* head = nullptr;
+};
+
+namespace detail {
+
+template <typename T>
+bool get_column(View const& v, Ref r, size_t rows, std::vector<T>& col)
+{
+    auto data = v.get<T>(r);
+    if (!data || data->size() != rows) return false;
+    col.assign(data->begin(), data->end());
+    return true;
+}
+
+template <typename TABLE>
+bool get_table(View const& v, TableRecord const& rec, TABLE& table)
+{
+    bool ok = get_column(v, rec.handles, rec.rows, table.handles);
+    size_t i = 0;
+    std::apply(
+        [&](auto&... col) {
+            ((ok = ok && get_column(v, rec.columns[i++], rec.rows, col)), ...);
+        },
+        table.columns());
+    table.changed.assign(table.handles.size(), 0);
+    return ok;
+}
+
+// Every live slot must point at the row holding its handle, and every
+// dead slot must be in the free list exactly once
+inline bool valid_slots(EntityStore const& e,
+                        std::span<EntityStore::Slot const> slots,
+                        std::span<uint32_t const> free_slots)
+{
+    size_t alive = 0;
+    for (uint32_t i = 0; i < slots.size(); i++) {
+        auto const& s = slots[i];
+        if (!s.alive) continue;
+        alive++;
+        std::vector<Handle> const* handles = nullptr;
+        switch (s.kind) {
+        case EntityKind::Robot:
+            handles = &e.robots.handles;
+            break;
+        case EntityKind::Projectile:
+            handles = &e.projectiles.handles;
+            break;
+        case EntityKind::Loot:
+            handles = &e.loot.handles;
+            break;
+        default:
+            return false;
+        }
+        if (s.row >= handles->size() ||
+            !((*handles)[s.row] == Handle{i, s.generation})) {
+            return false;
+        }
+    }
+    if (alive != e.robots.size() + e.projectiles.size() + e.loot.size() ||
+        free_slots.size() != slots.size() - alive) {
+        return false;
+    }
+    std::vector<bool> seen(slots.size());
+    for (auto i : free_slots) {
+        if (i >= slots.size() || slots[i].alive || seen[i]) return false;
+        seen[i] = true;
+    }
+    return true;
+}
+
+// Directions index the step tables, so they must be checked
+inline bool valid_entities(EntityStore const& e)
+{
+    auto bad_dir = [](uint8_t d) { return d >= 8; };
+    return std::none_of(e.robots.head.begin(), e.robots.head.end(),
+                        bad_dir) &&
+           std::none_of(e.projectiles.dir.begin(), e.projectiles.dir.end(),
+                        bad_dir) &&
+           std::all_of(e.robots.orders.begin(), e.robots.orders.end(),
+                       [](Orders const& o) {
+                           return valid_orders(pack_orders(o)) &&
+                                  unpack_orders(pack_orders(o)) == o;
+                       });
+}
+
+} // namespace detail
+
+// Rebuild a match from a save. The current turn gets the time that was
+// left of it when saved, counted from `now`. Returns null if the save is
+// inconsistent.
+inline std::unique_ptr<MatchState> load_match(View const& v,
+                                              MatchState::Clock::time_point now)
+{
+    using namespace detail;
+    using std::chrono::microseconds;
+
+    auto const& h = v.header();
+    auto m = std::make_unique<MatchState>(h.seed, std::span<uint32_t const>{},
+                                          microseconds(h.timeout_us), now);
+    std::copy(h.rng.begin(), h.rng.end(), std::begin(m->rng.s));
+
+    auto chunks = v.get<ChunkRecord>(h.chunks);
+    auto rooms = v.get<Room>(h.rooms);
+    auto loot = v.get<Loot>(h.loot);
+    if (!chunks || !rooms || !loot) return nullptr;
+    for (auto const& rec : *chunks) {
+        if (!in_range(rec.first_room, rec.room_count, rooms->size()) ||
+            !in_range(rec.first_loot, rec.loot_count, loot->size())) {
+            return nullptr;
+        }
+        auto& c = m->map.insert(rec.cx, rec.cy);
+        c.indoor = rec.indoor != 0;
+        c.cells = rec.cells;
+        auto r = rooms->subspan(rec.first_room, rec.room_count);
+        c.rooms.assign(r.begin(), r.end());
+        auto l = loot->subspan(rec.first_loot, rec.loot_count);
+        c.loot.assign(l.begin(), l.end());
+    }
+
+    auto& e = m->entities;
+    auto slot_records = v.get<SlotRecord>(h.slots);
+    auto free_slots = v.get<uint32_t>(h.free_slots);
+    if (!slot_records || !free_slots || !get_table(v, h.robots, e.robots) ||
+        !get_table(v, h.projectiles, e.projectiles) ||
+        !get_table(v, h.loot_items, e.loot)) {
+        return nullptr;
+    }
+    std::vector<EntityStore::Slot> slots(slot_records->size());
+    for (size_t i = 0; i < slots.size(); i++) {
+        auto const& s = (*slot_records)[i];
+        slots[i] = {s.generation, s.row, s.kind, s.alive != 0};
+    }
+    if (!valid_slots(e, slots, *free_slots) || !valid_entities(e)) {
+        return nullptr;
+    }
+    e.restore(slots, *free_slots);
+
+    auto decks = v.get<DeckRecord>(h.decks);
+    auto cards = v.get<Action>(h.cards);
+    if (!decks || !cards) return nullptr;
+    m->decks.resize(decks->size());
+    for (size_t i = 0; i < decks->size(); i++) {
+        auto const& rec = (*decks)[i];
+        if (!in_range(rec.first_card, rec.card_count, cards->size()) ||
+            rec.drawn > rec.card_count) {
+            return nullptr;
+        }
+        auto robot = e.find(rec.robot);
+        if (!robot || robot->kind != EntityKind::Robot) return nullptr;
+        auto c = cards->subspan(rec.first_card, rec.card_count);
+        if (std::any_of(c.begin(), c.end(),
+                        [](Action a) { return a > Action::Wait; })) {
+            return nullptr;
+        }
+        auto& d = m->decks[i];
+        d.robot = rec.robot;
+        d.drawn = rec.drawn;
+        d.cards.assign(c.begin(), c.end());
+    }
+
+    auto players = v.get<PlayerRecord>(h.players);
+    auto orders = v.get<OrdersRecord>(h.orders);
+    if (!players || !orders) return nullptr;
+    std::vector<TurnBarrier::Player> restored(players->size());
+    for (size_t i = 0; i < players->size(); i++) {
+        auto const& rec = (*players)[i];
+        if (!in_range(rec.first_robot, rec.robot_count, orders->size())) {
+            return nullptr;
+        }
+        auto& p = restored[i];
+        p.id = rec.id;
+        p.submitted = rec.submitted != 0;
+        p.missed = rec.missed;
+        auto robots = orders->subspan(rec.first_robot, rec.robot_count);
+        for (auto const& o : robots) {
+            if (!valid_orders(o.orders)) return nullptr;
+            p.robots.push_back({o.id, o.x, o.y, unpack_orders(o.orders)});
+        }
+    }
+    m->barrier.restore(h.turn, microseconds(h.timeout_us),
+                       now + microseconds(h.remaining_us), std::move(restored));
+    return m;
+}
+
+// Read only memory map of a whole file
+class MappedFile
+{
+public:
+    static std::optional<MappedFile> open(std::string const& path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return std::nullopt;
+        struct stat st; // NOLINT
+        MappedFile f;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            auto* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                f.ptr = static_cast<uint8_t const*>(p);
+                f.size = st.st_size;
+            }
+        }
+        close(fd);
+        if (f.ptr == nullptr) return std::nullopt;
+        return f;
+    }
+
+    MappedFile(MappedFile&& other) noexcept
+        : ptr(std::exchange(other.ptr, nullptr)),
+          size(std::exchange(other.size, 0))
+    {}
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile&&) = delete;
+
+    ~MappedFile()
+    {
+        if (ptr != nullptr) munmap(const_cast<uint8_t*>(ptr), size);
+    }
+
+    std::span<uint8_t const> data() const { return {ptr, size}; }
+
+private:
+    MappedFile() = default;
+    uint8_t const* ptr = nullptr;
+    size_t size = 0;
+};
+
+// Sync the directory holding `path`, so that a rename into it is durable
+inline bool sync_parent(std::string const& path)
+{
+    auto slash = path.rfind('/');
+    auto dir = slash == std::string::npos ? std::string(".")
+               : slash == 0               ? std::string("/")
+                                          : path.substr(0, slash);
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return false;
+    bool ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+}
+
+// Write `data` to a temporary file and rename it over `path`, so that
+// `path` always holds a complete save, also after a crash
+inline bool write_file(std::string const& path, std::span<uint8_t const> data)
+{
+    auto tmp = path + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                    0644);
+    if (fd < 0) return false;
+    size_t done = 0;
+    while (done < data.size()) {
+        auto n = ::write(fd, data.data() + done, data.size() - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += n;
+    }
+    bool ok = done == data.size() && fdatasync(fd) == 0;
+    ok = close(fd) == 0 && ok;
+    if (ok) ok = std::rename(tmp.c_str(), path.c_str()) == 0;
+    if (!ok) {
+        unlink(tmp.c_str());
+        return false;
+    }
+    return sync_parent(path);
+}
+
+inline std::unique_ptr<MatchState> load_file(std::string const& path,
+                                             MatchState::Clock::time_point now)
+{
+    auto file = MappedFile::open(path);
+    if (!file) return nullptr;
+    auto view = View::open(file->data());
+    if (!view) return nullptr;
+    return load_match(*view, now);
+}
+
+// Load many saves on `threads` threads (0 = one per core). Entries for
+// saves that could not be loaded are null.
+inline std::vector<std::unique_ptr<MatchState>>
+load_files(std::span<std::string const> paths,
+           MatchState::Clock::time_point now, unsigned threads = 0)
+{
+    std::vector<std::unique_ptr<MatchState>> result(paths.size());
+    parallel_for(paths.size(), threads, [&](size_t i, unsigned) {
+        result[i] = load_file(paths[i], now);
+    });
+    return result;
+}
+
+// Writes saves in the background. `save()` serializes the match into a
+// spare buffer on the calling thread, which is a copy of the state in
+// memory with no I/O, and hands the buffer to the writer thread. Two
+// buffers take turns. While a save is still being written new ones are
+// skipped rather than waited for, so the tick never blocks on the disk.
+class SaveThread
+{
+public:
+    using Clock = MatchState::Clock;
+
+    // Save every `interval` turns when using `on_turn()`
+    uint32_t interval = 10;
+
+    SaveThread() = default;
+    SaveThread(SaveThread const&) = delete;
+    SaveThread& operator=(SaveThread const&) = delete;
+
+    ~SaveThread()
+    {
+        {
+            std::lock_guard lock(mutex);
+            quit = true;
+        }
+        wake.notify_one();
+        thread.join();
+    }
+
+    // Call once per turn; saves when the turn number is a multiple of
+    // `interval`
+    bool on_turn(MatchState const& m, std::string const& path,
+                 Clock::time_point now)
+    {
+        auto turn = m.barrier.turn();
+        if (interval == 0 || turn % interval != 0) return false;
+        return save(m, path, now);
+    }
+
+    // Returns false if the previous save is still being written
+    bool save(MatchState const& m, std::string path, Clock::time_point now)
+    {
+        {
+            std::lock_guard lock(mutex);
+            if (pending) return false;
+        }
+        save_match(m, spare, now);
+        {
+            std::lock_guard lock(mutex);
+            std::swap(spare, busy);
+            busy_path = std::move(path);
+            pending = true;
+        }
+        wake.notify_one();
+        return true;
+    }
+
+    // Block until the last save has been written
+    void wait()
+    {
+        std::unique_lock lock(mutex);
+        idle.wait(lock, [&] { return !pending; });
+    }
+
+    uint64_t written() const { return written_; }
+    uint64_t errors() const { return errors_; }
+
+private:
+    void run()
+    {
+        std::unique_lock lock(mutex);
+        while (true) {
+            wake.wait(lock, [&] { return pending || quit; });
+            if (!pending) return;
+            // `busy` and `busy_path` are left alone while `pending` is set
+            lock.unlock();
+            bool ok = write_file(busy_path, busy);
+            lock.lock();
+            (ok ? written_ : errors_)++;
+            pending = false;
+            idle.notify_all();
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    bool pending = false;
+    bool quit = false;
+    std::vector<uint8_t> spare;
+    std::vector<uint8_t> busy;
+    std::string busy_path;
+    std::atomic<uint64_t> written_{0};
+    std::atomic<uint64_t> errors_{0};
+    // Last, so everything above exists before the thread starts
+    std::thread thread{[this] { run(); }};
+};
+
+} // namespace robo::save
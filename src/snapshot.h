@@ -0,0 +1,415 @@
+#pragma once
+
+#include "spatial_grid.h"
+#include "turn_protocol.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+// Per client world snapshots. Each client only gets the entities close to
+// its own robots, encoded as a delta against the last snapshot it has
+// acknowledged:
+//
+//  u8      version
+//  u8      message type
+//  varint  sequence number
+//  varint  baseline sequence number, 0 for a full snapshot
+//  varint  removed count, then per entity: varint id delta
+//  varint  added count, then per entity:
+//            varint id delta, u8 kind, zigzag x, zigzag y, u8 dir,
+//            varint hp, varint owner
+//  varint  changed count, then per entity:
+//            varint id delta, u8 field mask, then the changed fields in
+//            mask order (positions as zigzag delta from the baseline)
+//
+// Ids in each list are delta coded against the previous id in that list.
+
+namespace robo {
+
+enum class EntityKind : uint8_t
+{
+    Robot,
+    Projectile,
+    Loot,
+};
+
+struct EntityState
+{
+    uint32_t id = 0;
+    EntityKind kind = EntityKind::Robot;
+    uint8_t dir = 0;
+    uint16_t hp = 0;
+    int32_t x = 0;
+    int32_t y = 0;
+    uint32_t owner = 0;
+
+    bool operator==(EntityState const&) const = default;
+};
+
+namespace snapshot {
+
+enum Field : uint8_t
+{
+    X = 1,
+    Y = 2,
+    Dir = 4,
+    Hp = 8,
+    Owner = 16,
+    Kind = 32,
+};
+
+constexpr size_t history = 32;
+
+inline uint8_t changed_fields(EntityState const& a, EntityState const& b)
+{
+    return (a.x != b.x ? X : 0) | (a.y != b.y ? Y : 0) |
+           (a.dir != b.dir ? Dir : 0) | (a.hp != b.hp ? Hp : 0) |
+           (a.owner != b.owner ? Owner : 0) | (a.kind != b.kind ? Kind : 0);
+}
+
+// Walk two id sorted entity lists, calling `removed(old)`, `added(cur)`
+// or `both(old, cur)` for every id.
+template <typename R, typename A, typename B>
+void diff(std::span<EntityState const> base, std::span<EntityState const> cur,
+          R const& removed, A const& added, B const& both)
+{
+    size_t i = 0;
+    size_t j = 0;
+    while (i < base.size() || j < cur.size()) {
+        if (j == cur.size() || (i < base.size() && base[i].id < cur[j].id)) {
+            removed(base[i++]);
+        } else if (i == base.size() || cur[j].id < base[i].id) {
+            added(cur[j++]);
+        } else {
+            both(base[i++], cur[j++]);
+        }
+    }
+}
+
+} // namespace snapshot
+
+class SnapshotServer
+{
+public:
+    // Half size of the square around each robot that its owner can see
+    int32_t view_range = 24;
+    // Send a full snapshot at least this often (in snapshots)
+    uint32_t full_interval = 64;
+
+    // Index the world for this tick. `world` must be sorted on id and stay
+    // valid until the next call.
+    void update(std::span<EntityState const> world_)
+    {
+        world = world_;
+        grid.clear();
+        for (auto& [_, robots] : owned) {
+            robots.clear();
+        }
+        for (uint32_t i = 0; i < world.size(); i++) {
+            auto const& e = world[i];
+            grid.insert(i, e.x, e.y);
+            if (e.kind == EntityKind::Robot) {
+                owned[e.owner].push_back(i);
+            }
+        }
+    }
+
+    void add_client(uint32_t player) { clients[player].player = player; }
+    void remove_client(uint32_t player) { clients.erase(player); }
+
+    // Client `player` has received snapshot `seq`
+    void ack(uint32_t player, uint32_t seq)
+    {
+        auto it = clients.find(player);
+        if (it == clients.end()) return;
+        auto& c = it->second;
+        if (seq > c.acked && seq < c.next_seq) c.acked = seq;
+    }
+
+    // Append the next snapshot for `player` to `out`
+    void encode(uint32_t player, std::vector<uint8_t>& out)
+    {
+        auto it = clients.find(player);
+        if (it == clients.end()) return;
+        auto& c = it->second;
+        auto seq = c.next_seq++;
+
+        // Gather everything close to one of the players robots
+        c.visible.clear();
+        auto const& robots = owned[player];
+        for (auto i : robots) {
+            auto const& r = world[i];
+            grid.query(r.x - view_range, r.y - view_range, r.x + view_range,
+                       r.y + view_range,
+                       [&](uint32_t v) { c.visible.push_back(v); });
+        }
+        std::sort(c.visible.begin(), c.visible.end());
+        c.visible.erase(std::unique(c.visible.begin(), c.visible.end()),
+                        c.visible.end());
+
+        auto& sent = c.sent[seq % snapshot::history];
+        sent.seq = seq;
+        sent.entities.clear();
+        for (auto i : c.visible) {
+            sent.entities.push_back(world[i]);
+        }
+
+        uint32_t base_seq = 0;
+        std::span<EntityState const> base;
+        auto const& acked = c.sent[c.acked % snapshot::history];
+        if (c.acked != 0 && acked.seq == c.acked &&
+            seq - c.acked < snapshot::history &&
+            seq - c.last_full < full_interval) {
+            base_seq = c.acked;
+            base = acked.entities;
+        } else {
+            c.last_full = seq;
+        }
+
+        write(out, seq, base_seq, base, sent.entities);
+    }
+
+private:
+    static void write(std::vector<uint8_t>& out, uint32_t seq,
+                      uint32_t base_seq, std::span<EntityState const> base,
+                      std::span<EntityState const> cur)
+    {
+        using namespace snapshot;
+        out.push_back(protocol_version);
+        out.push_back(static_cast<uint8_t>(MessageType::Snapshot));
+        put_varint(out, seq);
+        put_varint(out, base_seq);
+
+        // Each list is written behind a count we only know afterwards, so
+        // make one pass per list.
+        auto nop = [](auto const&...) {};
+        uint32_t count = 0;
+        uint32_t id = 0;
+
+        diff(base, cur, [&](auto const&) { count++; }, nop, nop);
+        put_varint(out, count);
+        diff(
+            base, cur,
+            [&](EntityState const& e) {
+                put_varint(out, e.id - id);
+                id = e.id;
+            },
+            nop, nop);
+
+        count = id = 0;
+        diff(base, cur, nop, [&](auto const&) { count++; }, nop);
+        put_varint(out, count);
+        diff(
+            base, cur, nop,
+            [&](EntityState const& e) {
+                put_varint(out, e.id - id);
+                id = e.id;
+                out.push_back(static_cast<uint8_t>(e.kind));
+                put_varint(out, zigzag(e.x));
+                put_varint(out, zigzag(e.y));
+                out.push_back(e.dir);
+                put_varint(out, e.hp);
+                put_varint(out, e.owner);
+            },
+            nop);
+
+        count = id = 0;
+        diff(base, cur, nop, nop, [&](auto const& a, auto const& b) {
+            count += a == b ? 0 : 1;
+        });
+        put_varint(out, count);
+        diff(base, cur, nop, nop,
+             [&](EntityState const& a, EntityState const& b) {
+                 auto mask = changed_fields(a, b);
+                 if (mask == 0) return;
+                 put_varint(out, b.id - id);
+                 id = b.id;
+                 out.push_back(mask);
+                 if (mask & X) put_varint(out, delta(a.x, b.x));
+                 if (mask & Y) put_varint(out, delta(a.y, b.y));
+                 if (mask & Dir) out.push_back(b.dir);
+                 if (mask & Hp) put_varint(out, b.hp);
+                 if (mask & Owner) put_varint(out, b.owner);
+                 if (mask & Kind) out.push_back(static_cast<uint8_t>(b.kind));
+             });
+    }
+
+    struct Sent
+    {
+        uint32_t seq = 0;
+        std::vector<EntityState> entities;
+    };
+
+    struct Client
+    {
+        uint32_t player = 0;
+        uint32_t next_seq = 1;
+        uint32_t acked = 0;
+        uint32_t last_full = 0;
+        std::array<Sent, snapshot::history> sent;
+        std::vector<uint32_t> visible;
+    };
+
+    std::span<EntityState const> world;
+    SpatialGrid grid;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> owned;
+    std::unordered_map<uint32_t, Client> clients;
+};
+
+// Client side; rebuilds the visible world from incoming snapshots.
+class SnapshotClient
+{
+public:
+    // Apply an encoded snapshot. Returns false if it is malformed or based
+    // on a snapshot we no longer have. On success, `seq()` should be acked.
+    bool apply(std::span<uint8_t const> data)
+    {
+        using namespace snapshot;
+        auto const* p = data.data();
+        auto const* end = p + data.size();
+        if (data.size() < 2 || p[0] != protocol_version ||
+            p[1] != static_cast<uint8_t>(MessageType::Snapshot)) {
+            return false;
+        }
+        p += 2;
+        uint32_t seq = 0;
+        uint32_t base_seq = 0;
+        if (!get_varint(p, end, seq) || !get_varint(p, end, base_seq) ||
+            seq == 0 || base_seq >= seq) {
+            return false;
+        }
+        // Too old; its slot has been reused
+        if (seq + history <= latest) return false;
+        std::span<EntityState const> base;
+        if (base_seq != 0) {
+            auto const& b = received[base_seq % history];
+            if (b.seq != base_seq || seq - base_seq >= history) return false;
+            base = b.entities;
+        }
+
+        auto& target = received[seq % history];
+        scratch.clear();
+
+        // Removals
+        uint32_t count = 0;
+        uint32_t id = 0;
+        size_t bi = 0;
+        if (!get_varint(p, end, count)) return false;
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t delta = 0;
+            if (!get_varint(p, end, delta)) return false;
+            id += delta;
+            // Everything in the baseline up to the removed id is kept
+            while (bi < base.size() && base[bi].id < id) {
+                scratch.push_back(base[bi++]);
+            }
+            if (bi == base.size() || base[bi].id != id) return false;
+            bi++;
+        }
+        scratch.insert(scratch.end(), base.begin() + bi, base.end());
+
+        // Additions; merged in id order afterwards
+        size_t const kept = scratch.size();
+        id = 0;
+        if (!get_varint(p, end, count)) return false;
+        for (uint32_t i = 0; i < count; i++) {
+            EntityState e;
+            uint32_t v = 0;
+            if (!get_varint(p, end, v) || (i > 0 && v == 0)) return false;
+            e.id = id += v;
+            if (end - p < 1) return false;
+            e.kind = static_cast<EntityKind>(*p++);
+            if (!get_varint(p, end, v)) return false;
+            e.x = unzigzag(v);
+            if (!get_varint(p, end, v)) return false;
+            e.y = unzigzag(v);
+            if (end - p < 1) return false;
+            e.dir = *p++;
+            if (!get_varint(p, end, v)) return false;
+            e.hp = static_cast<uint16_t>(v);
+            if (!get_varint(p, end, e.owner)) return false;
+            scratch.push_back(e);
+        }
+        std::inplace_merge(
+            scratch.begin(), scratch.begin() + kept, scratch.end(),
+            [](auto const& a, auto const& b) { return a.id < b.id; });
+        if (std::adjacent_find(scratch.begin(), scratch.end(),
+                               [](auto const& a, auto const& b) {
+                                   return a.id == b.id;
+                               }) != scratch.end()) {
+            return false;
+        }
+
+        // Field changes
+        id = 0;
+        auto it = scratch.begin();
+        if (!get_varint(p, end, count)) return false;
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t v = 0;
+            if (!get_varint(p, end, v)) return false;
+            id += v;
+            it = std::lower_bound(
+                it, scratch.end(), id,
+                [](auto const& e, uint32_t id) { return e.id < id; });
+            if (it == scratch.end() || it->id != id || end - p < 1) {
+                return false;
+            }
+            auto& e = *it;
+            auto mask = *p++;
+            if (mask & X) {
+                if (!get_varint(p, end, v)) return false;
+                e.x = apply_delta(e.x, v);
+            }
+            if (mask & Y) {
+                if (!get_varint(p, end, v)) return false;
+                e.y = apply_delta(e.y, v);
+            }
+            if (mask & Dir) {
+                if (end - p < 1) return false;
+                e.dir = *p++;
+            }
+            if (mask & Hp) {
+                if (!get_varint(p, end, v)) return false;
+                e.hp = static_cast<uint16_t>(v);
+            }
+            if (mask & Owner) {
+                if (!get_varint(p, end, e.owner)) return false;
+            }
+            if (mask & Kind) {
+                if (end - p < 1) return false;
+                e.kind = static_cast<EntityKind>(*p++);
+            }
+        }
+        if (p != end) return false;
+
+        target.seq = seq;
+        std::swap(target.entities, scratch);
+        latest = std::max(latest, seq);
+        return true;
+    }
+
+    uint32_t seq() const { return latest; }
+
+    // Entities in the latest snapshot, sorted on id
+    std::vector<EntityState> const& entities() const
+    {
+        return received[latest % snapshot::history].entities;
+    }
+
+private:
+    struct Received
+    {
+        uint32_t seq = 0;
+        std::vector<EntityState> entities;
+    };
+
+    std::array<Received, snapshot::history> received;
+    std::vector<EntityState> scratch;
+    uint32_t latest = 0;
+};
+
+} // namespace robo
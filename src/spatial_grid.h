@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace robo {
+
+// Uniform grid bucketing of points, rebuilt every tick. Buckets are hashed
+// into a fixed table so the grid can cover an unbounded world.
+class SpatialGrid
+{
+public:
+    explicit SpatialGrid(int32_t cell_size_ = 16, size_t buckets_ = 4096)
+        : cell_size(cell_size_), buckets(buckets_)
+    {}
+
+    void clear()
+    {
+        // Keep the capacity of every bucket
+        for (auto& b : buckets) {
+            b.clear();
+        }
+    }
+
+    void insert(uint32_t value, int32_t x, int32_t y)
+    {
+        buckets[bucket(cell(x), cell(y))].push_back({value, x, y});
+    }
+
+    // Call `fn(value)` for every value inside the rectangle (inclusive)
+    template <typename FN>
+    void query(int32_t x0, int32_t y0, int32_t x1, int32_t y1,
+               FN const& fn) const
+    {
+        auto cx1 = cell(x1);
+        auto cy1 = cell(y1);
+        for (auto cy = cell(y0); cy <= cy1; cy++) {
+            for (auto cx = cell(x0); cx <= cx1; cx++) {
+                for (auto const& e : buckets[bucket(cx, cy)]) {
+                    // Skip entries from other cells sharing this bucket
+                    if (cell(e.x) != cx || cell(e.y) != cy) continue;
+                    if (e.x >= x0 && e.x <= x1 && e.y >= y0 && e.y <= y1) {
+                        fn(e.value);
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    struct Entry
+    {
+        uint32_t value;
+        int32_t x;
+        int32_t y;
+    };
+
+    int32_t cell(int32_t v) const
+    {
+        // Round towards negative infinity
+        return v >= 0 ? v / cell_size : (v + 1) / cell_size - 1;
+    }
+
+    size_t bucket(int32_t cx, int32_t cy) const
+    {
+        auto h = static_cast<uint32_t>(cx) * 0x9e3779b1U ^
+                 static_cast<uint32_t>(cy) * 0x85ebca77U;
+        return h % buckets.size();
+    }
+
+    int32_t cell_size;
+    std::vector<std::vector<Entry>> buckets;
+};
+
+} // namespace robo
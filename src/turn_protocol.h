@@ -0,0 +1,358 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <optional>
+#include <span>
+#include <vector>
+
+// Binary wire format for turn submissions.
+//
+//  u8      version
+//  u8      message type
+//  varint  turn
+//  varint  player
+//  varint  robot count
+//  robot count times:
+//    varint  robot id, delta from previous robot id
+//    zigzag  x, delta from previous robot
+//    zigzag  y, delta from previous robot
+//    u32     packed orders (little endian)
+//
+// Robots must be sent in increasing id order. See `pack_orders()` for the
+// layout of the orders word.
+
+namespace robo {
+
+constexpr uint8_t protocol_version = 1;
+
+enum class MessageType : uint8_t
+{
+    Submit = 1,
+    Snapshot = 2,
+};
+
+enum class Action : uint8_t
+{
+    None,
+    Move,
+    TurnHead,
+    Wait,
+};
+
+enum class Reaction : uint8_t
+{
+    Avoid,        // Backtrack until turn ends or no robot seen
+    MovingAttack, // Fire and continue moving
+    StopAndFire,  // Stop and fire until end of round or target destroyed
+};
+
+// Step for each of the 8 directions, 0 = north and then clockwise, with y
+// growing southwards
+constexpr std::array<int32_t, 8> dir_x{0, 1, 1, 1, 0, -1, -1, -1};
+constexpr std::array<int32_t, 8> dir_y{-1, -1, 0, 1, 1, 1, 0, -1};
+
+// One action slot; `dir` indexes `dir_x` and `dir_y`
+struct Slot
+{
+    Action action = Action::None;
+    uint8_t dir = 0;
+
+    bool operator==(Slot const&) const = default;
+};
+
+constexpr int slot_count = 5;
+
+struct Orders
+{
+    std::array<Slot, slot_count> slots{};
+    Reaction reaction = Reaction::Avoid;
+
+    bool operator==(Orders const&) const = default;
+};
+
+struct RobotOrders
+{
+    uint32_t id = 0;
+    int32_t x = 0;
+    int32_t y = 0;
+    Orders orders;
+};
+
+// Slot i occupies bits [5i, 5i+5): 2 bit action, 3 bit direction.
+// The reaction sits in bits 25-26, the rest must be zero.
+inline uint32_t pack_orders(Orders const& o)
+{
+    uint32_t bits = 0;
+    for (int i = 0; i < slot_count; i++) {
+        auto const& s = o.slots[i];
+        bits |= ((static_cast<uint32_t>(s.action) & 3) |
+                 ((s.dir & 7U) << 2))
+                << (i * 5);
+    }
+    bits |= (static_cast<uint32_t>(o.reaction) & 3) << 25;
+    return bits;
+}
+
+inline bool valid_orders(uint32_t bits)
+{
+    return (bits >> 27) == 0 &&
+           ((bits >> 25) & 3) <= static_cast<uint32_t>(Reaction::StopAndFire);
+}
+
+inline Orders unpack_orders(uint32_t bits)
+{
+    Orders o;
+    for (int i = 0; i < slot_count; i++) {
+        auto s = bits >> (i * 5);
+        o.slots[i] = {static_cast<Action>(s & 3),
+                      static_cast<uint8_t>((s >> 2) & 7)};
+    }
+    o.reaction = static_cast<Reaction>((bits >> 25) & 3);
+    return o;
+}
+
+inline uint32_t zigzag(int32_t v)
+{
+    return (static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31);
+}
+
+inline int32_t unzigzag(uint32_t v)
+{
+    return static_cast<int32_t>((v >> 1) ^ (~(v & 1) + 1));
+}
+
+// Zigzag encoded difference `to - from`, and its inverse. The arithmetic
+// is unsigned so that any value, including hostile wire data, wraps the
+// same way on both ends instead of overflowing.
+inline uint32_t delta(int32_t from, int32_t to)
+{
+    return zigzag(
+        static_cast<int32_t>(static_cast<uint32_t>(to) -
+                             static_cast<uint32_t>(from)));
+}
+
+inline int32_t apply_delta(int32_t base, uint32_t v)
+{
+    return static_cast<int32_t>(static_cast<uint32_t>(base) +
+                                static_cast<uint32_t>(unzigzag(v)));
+}
+
+inline void put_varint(std::vector<uint8_t>& out, uint32_t v)
+{
+    while (v >= 0x80) {
+        out.push_back(static_cast<uint8_t>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(v));
+}
+
+// Reads a varint at `p`, advancing it. Returns false on truncated or
+// over-long input. Does not check bounds when `end` is null.
+inline bool get_varint(uint8_t const*& p, uint8_t const* end, uint32_t& v)
+{
+    v = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (end != nullptr && p == end) return false;
+        uint8_t const b = *p++;
+        v |= static_cast<uint32_t>(b & 0x7f) << shift;
+        if ((b & 0x80) == 0) return shift < 28 || b < 0x10;
+    }
+    return false;
+}
+
+// Encode a submission, appending to `out` (which may be reused between
+// calls to avoid allocation). `robots` must be sorted on id.
+inline void encode_submission(std::vector<uint8_t>& out, uint32_t turn,
+                              uint32_t player,
+                              std::span<RobotOrders const> robots)
+{
+    out.push_back(protocol_version);
+    out.push_back(static_cast<uint8_t>(MessageType::Submit));
+    put_varint(out, turn);
+    put_varint(out, player);
+    put_varint(out, static_cast<uint32_t>(robots.size()));
+    uint32_t id = 0;
+    int32_t x = 0;
+    int32_t y = 0;
+    for (auto const& r : robots) {
+        put_varint(out, r.id - id);
+        put_varint(out, delta(x, r.x));
+        put_varint(out, delta(y, r.y));
+        auto bits = pack_orders(r.orders);
+        for (int i = 0; i < 4; i++) {
+            out.push_back(static_cast<uint8_t>(bits >> (i * 8)));
+        }
+        id = r.id;
+        x = r.x;
+        y = r.y;
+    }
+}
+
+// Zero-copy view of an encoded submission. Use `parse()` to validate a
+// buffer; iteration afterwards decodes directly from the buffer without
+// further checks. The buffer must outlive the view.
+class SubmissionView
+{
+public:
+    static std::optional<SubmissionView> parse(std::span<uint8_t const> data)
+    {
+        auto const* p = data.data();
+        auto const* end = p + data.size();
+        if (data.size() < 2 || p[0] != protocol_version ||
+            p[1] != static_cast<uint8_t>(MessageType::Submit)) {
+            return std::nullopt;
+        }
+        p += 2;
+        SubmissionView v;
+        if (!get_varint(p, end, v.turn_) || !get_varint(p, end, v.player_) ||
+            !get_varint(p, end, v.count_)) {
+            return std::nullopt;
+        }
+        // Every robot needs at least 7 bytes; reject absurd counts early
+        if (v.count_ > static_cast<size_t>(end - p) / 7) return std::nullopt;
+        v.robots_ = p;
+        uint32_t id = 0;
+        uint32_t tmp = 0;
+        for (uint32_t i = 0; i < v.count_; i++) {
+            uint32_t delta = 0;
+            if (!get_varint(p, end, delta)) return std::nullopt;
+            // Ids must be strictly increasing and not wrap
+            if ((i > 0 && delta == 0) || id + delta < id) return std::nullopt;
+            id += delta;
+            if (!get_varint(p, end, tmp) || !get_varint(p, end, tmp)) {
+                return std::nullopt;
+            }
+            if (end - p < 4) return std::nullopt;
+            if (!valid_orders(read_u32(p))) return std::nullopt;
+            p += 4;
+        }
+        if (p != end) return std::nullopt;
+        return v;
+    }
+
+    uint32_t turn() const { return turn_; }
+    uint32_t player() const { return player_; }
+    uint32_t size() const { return count_; }
+
+    class iterator
+    {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = RobotOrders;
+        using difference_type = std::ptrdiff_t;
+        using pointer = RobotOrders const*;
+        using reference = RobotOrders const&;
+
+        RobotOrders const& operator*() const { return cur; }
+        RobotOrders const* operator->() const { return &cur; }
+
+        iterator& operator++()
+        {
+            if (--left > 0) next();
+            return *this;
+        }
+
+        bool operator==(iterator const& other) const
+        {
+            return left == other.left;
+        }
+
+    private:
+        friend class SubmissionView;
+        iterator(uint8_t const* p_, uint32_t left_) : p(p_), left(left_)
+        {
+            if (left > 0) next();
+        }
+
+        void next()
+        {
+            uint32_t v = 0;
+            get_varint(p, nullptr, v);
+            cur.id += v;
+            get_varint(p, nullptr, v);
+            cur.x = apply_delta(cur.x, v);
+            get_varint(p, nullptr, v);
+            cur.y = apply_delta(cur.y, v);
+            cur.orders = unpack_orders(read_u32(p));
+            p += 4;
+        }
+
+        uint8_t const* p;
+        uint32_t left;
+        RobotOrders cur;
+    };
+
+    iterator begin() const { return {robots_, count_}; }
+    iterator end() const { return {nullptr, 0}; }
+
+private:
+    SubmissionView() = default;
+
+    static uint32_t read_u32(uint8_t const* p)
+    {
+        return p[0] | (p[1] << 8) | (p[2] << 16) |
+               (static_cast<uint32_t>(p[3]) << 24);
+    }
+
+    uint32_t turn_ = 0;
+    uint32_t player_ = 0;
+    uint32_t count_ = 0;
+    uint8_t const* robots_ = nullptr;
+};
+
+// Splits a byte stream into varint length prefixed frames, for use over
+// stream sockets.
+class FrameReader
+{
+public:
+    static constexpr uint32_t max_frame = 1 << 20;
+
+    static void write_frame(std::vector<uint8_t>& out,
+                            std::span<uint8_t const> frame)
+    {
+        put_varint(out, static_cast<uint32_t>(frame.size()));
+        out.insert(out.end(), frame.begin(), frame.end());
+    }
+
+    void feed(std::span<uint8_t const> data)
+    {
+        if (pos > 0) {
+            buffer.erase(buffer.begin(), buffer.begin() + pos);
+            pos = 0;
+        }
+        buffer.insert(buffer.end(), data.begin(), data.end());
+    }
+
+    // Returns the next complete frame, or nullopt if more data is needed.
+    // Frames may be empty. The frame is valid until the next call to
+    // `feed()`. Sets `error` on an oversized frame.
+    std::optional<std::span<uint8_t const>> next()
+    {
+        auto const* start = buffer.data() + pos;
+        auto const* end = buffer.data() + buffer.size();
+        auto const* p = start;
+        uint32_t size = 0;
+        if (!get_varint(p, end, size)) {
+            if (end - start >= 5) error = true;
+            return std::nullopt;
+        }
+        if (size > max_frame) {
+            error = true;
+            return std::nullopt;
+        }
+        if (static_cast<size_t>(end - p) < size) return std::nullopt;
+        pos = (p - buffer.data()) + size;
+        return std::span<uint8_t const>{p, size};
+    }
+
+    bool error = false;
+
+private:
+    std::vector<uint8_t> buffer;
+    size_t pos = 0;
+};
+
+} // namespace robo